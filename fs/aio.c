@@ -0,0 +1,407 @@
+/*
+ *  linux/fs/aio.c
+ */
+
+/*
+ * 'aio.c' lets a process start reads and writes without waiting for them:
+ * io_submit() puts the blocks of a batch of requests on the request queue
+ * with ll_rw_block() and returns, io_getevents() later collects the ones
+ * that are done. A process that keeps many of them submitted keeps the
+ * disk queue deep, which gives the elevator something to sort.
+ *
+ * A context is a page with the submitted requests (kiocb) and the buffers
+ * they hold (aio_block). A request is done when none of its buffers is
+ * locked any more, as that is how end_request() reports a finished
+ * transfer. Data that is written is copied into the buffers at submit
+ * time, data that is read is copied out when the request is reaped.
+ *
+ * Only regular files and block devices can do this. Finding the blocks of
+ * a file may still have to read an indirect block, and writing part of a
+ * block has to read it first, so these parts still wait.
+ *
+ * A submitted block holds its buffer until it is reaped, so the buffers
+ * that contexts may hold are limited, per context and for all of them,
+ * to a small part of the cache. A process can have AIO_PER_TASK contexts,
+ * which go away at exit and exec.
+ */
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/aio.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/segment.h>
+#include <asm/system.h>
+
+#define NR_AIO		16
+#define AIO_PER_TASK	2
+#define AIO_MAX_REQS	64
+// 一个上下文和所有上下文最多拿着的buffer数
+#define AIO_CTX_PIN	(NR_BUFFERS/32)
+#define AIO_ALL_PIN	(NR_BUFFERS/8)
+
+struct aio_block {
+	struct buffer_head * bh;	/* NULL for a hole */
+	char * buf;			/* user buffer */
+	unsigned short offset, len;	/* in the block */
+	short next;			/* next of the request, or free */
+};
+
+struct kiocb {
+	unsigned long data;
+	long res;
+	short opcode;			/* -1 if the slot is free */
+	short first;			/* first aio_block, -1 if none */
+};
+
+struct aio_ctx {
+	struct task_struct * owner;
+	short nr;			/* kiocbs in use */
+	short nr_free;			/* free aio_blocks */
+	short free;
+	struct kiocb req[AIO_MAX_REQS];
+	struct aio_block block[1];
+};
+
+// 一个上下文占一页，剩下的都用来放aio_block
+#define AIO_MAX_BLOCKS \
+	((PAGE_SIZE-sizeof(struct aio_ctx))/sizeof(struct aio_block)+1)
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+static struct aio_ctx * aio_table[NR_AIO];
+static int aio_pinned = 0;		/* aio_blocks in use, all contexts */
+
+static inline void wait_on_buffer(struct buffer_head * bh)
+{
+	cli();
+	while (bh->b_lock)
+		sleep_on(&bh->b_wait);
+	sti();
+}
+
+// 上下文只能由创建它的进程使用，读的数据要复制到它的地址空间
+static struct aio_ctx * get_ctx(int id)
+{
+	if (id < 0 || id >= NR_AIO || !aio_table[id] ||
+	    aio_table[id]->owner != current)
+		return NULL;
+	return aio_table[id];
+}
+
+int sys_io_setup(int nr_events)
+{
+	struct aio_ctx * ctx;
+	int id, i;
+
+	if (nr_events <= 0)
+		return -EINVAL;
+	for (id = i = 0 ; id < NR_AIO ; id++)
+		if (aio_table[id] && aio_table[id]->owner == current)
+			i++;
+	if (i >= AIO_PER_TASK)
+		return -EAGAIN;
+	for (id = 0 ; id < NR_AIO ; id++)
+		if (!aio_table[id])
+			break;
+	if (id >= NR_AIO)
+		return -EAGAIN;
+	if (!(ctx = (struct aio_ctx *) get_free_page()))
+		return -ENOMEM;
+	ctx->owner = current;
+	for (i = 0 ; i < AIO_MAX_REQS ; i++)
+		ctx->req[i].opcode = -1;
+	for (i = 0 ; i < AIO_MAX_BLOCKS ; i++)
+		ctx->block[i].next = i+1;
+	ctx->block[AIO_MAX_BLOCKS-1].next = -1;
+	ctx->nr_free = AIO_MAX_BLOCKS;
+	aio_table[id] = ctx;
+	return id;
+}
+
+/*
+ * Releases the buffers of a request and returns its result. The data
+ * of a read is only copied if 'copy' is set: a request that is thrown
+ * away at exit has no address space to go to any more.
+ */
+static long aio_finish(struct aio_ctx * ctx, struct kiocb * req, int copy)
+{
+	struct aio_block * b;
+	long res = req->res;
+	int i, next;
+
+	copy = copy && req->opcode == IOCB_CMD_PREAD;
+	for (i = req->first ; i >= 0 ; i = next) {
+		b = ctx->block+i;
+		next = b->next;
+		// 提交之后fork()过的话页又是共享的了
+		if (copy)
+			verify_area(b->buf,b->len);
+		if (b->bh) {
+			if (!b->bh->b_uptodate)
+				res = -EIO;
+			else if (copy)
+				memcpy_tofs(b->buf,b->bh->b_data+b->offset,b->len);
+			brelse(b->bh);
+		} else if (copy)
+			memset_tofs(b->buf,b->len);
+		b->next = ctx->free;
+		ctx->free = i;
+		ctx->nr_free++;
+		aio_pinned--;
+	}
+	req->opcode = -1;
+	ctx->nr--;
+	return res;
+}
+
+static int aio_done(struct aio_ctx * ctx, struct kiocb * req)
+{
+	int i;
+
+	for (i = req->first ; i >= 0 ; i = ctx->block[i].next)
+		if (ctx->block[i].bh && ctx->block[i].bh->b_lock)
+			return 0;
+	return 1;
+}
+
+// 等一个还在传输的buffer，没有则直接返回
+static void aio_wait(struct aio_ctx * ctx)
+{
+	struct kiocb * req;
+	int i;
+
+	for (req = ctx->req ; req < ctx->req+AIO_MAX_REQS ; req++) {
+		if (req->opcode < 0)
+			continue;
+		for (i = req->first ; i >= 0 ; i = ctx->block[i].next)
+			if (ctx->block[i].bh && ctx->block[i].bh->b_lock) {
+				wait_on_buffer(ctx->block[i].bh);
+				return;
+			}
+	}
+}
+
+static void aio_free(int id)
+{
+	struct aio_ctx * ctx = aio_table[id];
+	struct kiocb * req;
+
+	while (ctx->nr) {
+		for (req = ctx->req ; req < ctx->req+AIO_MAX_REQS ; req++)
+			if (req->opcode >= 0 && aio_done(ctx,req))
+				aio_finish(ctx,req,0);
+		aio_wait(ctx);
+	}
+	aio_table[id] = NULL;
+	free_page((unsigned long) ctx);
+}
+
+int sys_io_destroy(int id)
+{
+	if (!get_ctx(id))
+		return -EINVAL;
+	aio_free(id);
+	return 0;
+}
+
+// do_exit()里调用，释放进程还没收回的请求
+void aio_exit(void)
+{
+	int id;
+
+	for (id = 0 ; id < NR_AIO ; id++)
+		if (aio_table[id] && aio_table[id]->owner == current)
+			aio_free(id);
+}
+
+/*
+ * Starts one request. Errors found before anything was started are
+ * returned, later ones (no space, a failed read of a partial block)
+ * end the request early and show up in its result.
+ */
+static int aio_submit_one(struct aio_ctx * ctx, struct iocb * user)
+{
+	struct m_inode * inode;
+	struct file * file;
+	struct kiocb * req;
+	struct aio_block * b;
+	struct buffer_head * bh;
+	short * last;
+	unsigned long data;
+	char * buf;
+	long nbytes, offset;
+	int opcode, fd, dev, block, nr, chars, one, handle, need, i;
+
+	data = get_fs_long(&user->data);
+	opcode = get_fs_long((unsigned long *) &user->opcode);
+	fd = get_fs_long((unsigned long *) &user->fd);
+	buf = (char *) get_fs_long((unsigned long *) &user->buf);
+	nbytes = get_fs_long((unsigned long *) &user->nbytes);
+	offset = get_fs_long((unsigned long *) &user->offset);
+	if (fd < 0 || fd >= NR_OPEN || !(file = current->filp[fd]) ||
+	    !(inode = file->f_inode))
+		return -EBADF;
+	if (opcode != IOCB_CMD_PREAD && opcode != IOCB_CMD_PWRITE)
+		return -EINVAL;
+	if (!(file->f_mode & (opcode == IOCB_CMD_PREAD ? 1 : 2)))
+		return -EBADF;
+	// offset+nbytes不能溢出，不然下面算出的need是负数
+	if (nbytes < 0 || offset < 0 || nbytes > 0x7fffffff - offset)
+		return -EINVAL;
+	if (S_ISBLK(inode->i_mode))
+		dev = inode->i_zone[0];
+	else if (S_ISREG(inode->i_mode))
+		dev = inode->i_dev;
+	else
+		return -EINVAL;
+	if (opcode == IOCB_CMD_PWRITE && journal_inode(inode))
+		return -ETXTBSY;
+	// 读普通文件不能超过文件尾
+	if (opcode == IOCB_CMD_PREAD && S_ISREG(inode->i_mode))
+		nbytes = (offset >= inode->i_size) ? 0 :
+			MIN(nbytes,inode->i_size-offset);
+	// 块设备没有i_size，一次最多做一个上下文放得下的
+	if (S_ISBLK(inode->i_mode))
+		nbytes = MIN(nbytes,AIO_CTX_PIN*BLOCK_SIZE-(offset&(BLOCK_SIZE-1)));
+	// 内核态写不管页的写保护，写时复制的页要先复制出来
+	if (opcode == IOCB_CMD_PREAD)
+		verify_area(buf,nbytes);
+	need = (offset+nbytes+BLOCK_SIZE-1)/BLOCK_SIZE - offset/BLOCK_SIZE;
+	// 永远也放不下的请求
+	if (need > AIO_CTX_PIN || need > AIO_MAX_BLOCKS)
+		return -EINVAL;
+	if (AIO_MAX_BLOCKS-ctx->nr_free+need > AIO_CTX_PIN ||
+	    ctx->nr_free < need || aio_pinned+need > AIO_ALL_PIN)
+		return -EAGAIN;
+	for (req = ctx->req ; req < ctx->req+AIO_MAX_REQS ; req++)
+		if (req->opcode < 0)
+			break;
+	if (req >= ctx->req+AIO_MAX_REQS)
+		return -EAGAIN;
+	// 先占上，下面会睡眠，没用完的最后还回去
+	aio_pinned += need;
+	req->data = data;
+	req->opcode = opcode;
+	req->res = 0;
+	req->first = -1;
+	last = &req->first;
+	ctx->nr++;
+	// 写普通文件要分配块，整个请求在一个日志句柄里，不超过J_WRITE能写的块
+	if (handle = (opcode == IOCB_CMD_PWRITE && S_ISREG(inode->i_mode)))
+		journal_start(J_WRITE);
+	while (nbytes > 0 && ctx->free >= 0) {
+		block = offset >> BLOCK_SIZE_BITS;
+		i = offset & (BLOCK_SIZE-1);
+		chars = MIN(BLOCK_SIZE-i,nbytes);
+		if (S_ISBLK(inode->i_mode))
+			nr = block;
+		else if (opcode == IOCB_CMD_PREAD)
+			nr = bmap(inode,block);
+		else {
+			one = 1;
+			if (!(nr = create_blocks(inode,block,&one))) {
+				req->res = req->res ? req->res : -ENOSPC;
+				break;
+			}
+		}
+		bh = NULL;
+		if (opcode == IOCB_CMD_PWRITE) {
+			// 整块都要写的不用先读进来
+			if (chars == BLOCK_SIZE) {
+				bh = getblk(dev,nr);
+				wait_on_buffer(bh);
+			} else if (!(bh = bread(dev,nr))) {
+				req->res = req->res ? req->res : -EIO;
+				break;
+			}
+			memcpy_fromfs(bh->b_data+i,buf,chars);
+			bh->b_uptodate = 1;
+			bh->b_dirt = 1;
+			ll_rw_block(WRITE,bh);
+			if (S_ISREG(inode->i_mode) && offset+chars > inode->i_size) {
+				inode->i_size = offset+chars;
+				inode->i_dirt = 1;
+			}
+		// 普通文件块号为0是空洞，收回时填0
+		} else if (nr || S_ISBLK(inode->i_mode)) {
+			bh = getblk(dev,nr);
+			if (!bh->b_uptodate)
+				ll_rw_block(READ,bh);
+		}
+		b = ctx->block+(*last = ctx->free);
+		ctx->free = b->next;
+		ctx->nr_free--;
+		need--;
+		b->bh = bh;
+		b->buf = buf;
+		b->offset = i;
+		b->len = chars;
+		b->next = -1;
+		last = &b->next;
+		req->res += chars;
+		offset += chars;
+		buf += chars;
+		nbytes -= chars;
+	}
+	if (handle) {
+		inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+		journal_stop();
+	}
+	aio_pinned -= need;
+	return 0;
+}
+
+int sys_io_submit(int id, int nr, struct iocb ** iocbpp)
+{
+	struct aio_ctx * ctx;
+	int i, error = 0;
+
+	if (!(ctx = get_ctx(id)) || nr < 0)
+		return -EINVAL;
+	for (i = 0 ; i < nr ; i++)
+		if ((error = aio_submit_one(ctx,(struct iocb *)
+		    get_fs_long((unsigned long *) (iocbpp+i)))) < 0)
+			break;
+	return i ? i : error;
+}
+
+/*
+ * Waits until at least min_nr requests are done, and returns up to nr
+ * of them. Requests are returned as they are found done, not in the
+ * order they were submitted.
+ */
+int do_io_getevents(int id, int min_nr, int nr, struct io_event * events)
+{
+	struct aio_ctx * ctx;
+	struct kiocb * req;
+	unsigned long data;
+	long res;
+	int count = 0;
+
+	if (!(ctx = get_ctx(id)) || min_nr < 0 || nr < min_nr)
+		return -EINVAL;
+	// 一次最多也就AIO_MAX_REQS个，大的nr会让下面的长度溢出
+	nr = MIN(nr,AIO_MAX_REQS);
+	min_nr = MIN(min_nr,AIO_MAX_REQS);
+	if (nr)
+		verify_area(events,nr*sizeof(struct io_event));
+	for (;;) {
+		for (req = ctx->req ; req < ctx->req+AIO_MAX_REQS ; req++) {
+			if (count >= nr)
+				break;
+			if (req->opcode < 0 || !aio_done(ctx,req))
+				continue;
+			data = req->data;
+			res = aio_finish(ctx,req,1);
+			put_fs_long(data,&events[count].data);
+			put_fs_long(res,(unsigned long *) &events[count].res);
+			count++;
+		}
+		if (count >= min_nr || !ctx->nr)
+			break;
+		aio_wait(ctx);
+	}
+	return count;
+}
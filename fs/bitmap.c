@@ -28,104 +28,312 @@ __asm__ __volatile__("btrl %2,%3\n\tsetnb %%al": \
 "=a" (res):"0" (0),"r" (nr),"m" (*(addr))); \
 res;})
 
-#define find_first_zero(addr) ({ \
-int __res; \
-__asm__("cld\n" \
-	"1:\tlodsl\n\t" \
-	"notl %%eax\n\t" \
-	"bsfl %%eax,%%edx\n\t" \
-	"je 2f\n\t" \
-	"addl %%edx,%%ecx\n\t" \
-	"jmp 3f\n" \
-	"2:\taddl $32,%%ecx\n\t" \
-	"cmpl $8192,%%ecx\n\t" \
-	"jl 1b\n" \
-	"3:" \
-	:"=c" (__res):"c" (0),"S" (addr):"ax","dx","si"); \
-__res;})
-// 释放硬盘的某个块的数据，清除buffer里该数据块对应的数据，数据块位图对应的位置0，等待回写硬盘，硬盘的数据还存在
-void free_block(int dev, int block)
+// 位图的位数：inode位图从0到s_ninodes，数据块位图从0到数据块数
+#define IMAP_BITS(sb) ((sb)->s_ninodes+1)
+#define ZMAP_BITS(sb) ((sb)->s_nzones-(sb)->s_firstdatazone+1)
+
+/*
+ * The bitmap routines below work on whole 32-bit words: runs of words
+ * that are all ones (or all zeroes) are skipped with "repe scasl", and
+ * only the word where the answer is gets looked at bit by bit. There is
+ * no SSE version: the kernel doesn't save the fpu/sse state for its own
+ * use, and can't touch those registers without doing so.
+ */
+#define BITMAP_WORDS (8192/32)
+
+// 返回word中最低的1位，word不能为0
+static inline int ffs1(unsigned long word)
+{
+	int res;
+
+	__asm__("bsfl %1,%0":"=r" (res):"r" (word));
+	return res;
+}
+
+// 从p开始最多n个字，跳过等于value的字，返回第一个不等于value的字，都相等则返回p+n
+static inline unsigned long * skip_words(unsigned long * p, int n,
+	unsigned long value)
+{
+	if (n <= 0)
+		return p;
+	__asm__("cld\n\t"
+		"repe ; scasl\n\t"
+		"je 1f\n\t"
+		"subl $4,%%edi\n"
+		"1:"
+		:"=D" (p),"=c" (n)
+		:"a" (value),"0" (p),"1" (n));
+	return p;
+}
+
+/*
+ * find_bit_from() returns the first bit at or after 'start' in a bitmap
+ * block that is 0 (want==0) or 1 (want==1), or 8192 if there is none.
+ */
+static int find_bit_from(char * addr, int start, int want)
+{
+	unsigned long * p = (unsigned long *) addr + (start >> 5);
+	unsigned long word, skip = want ? 0 : 0xffffffff;
+
+	if (start >= 8192)
+		return 8192;
+	// 第一个字中start前面的位不算
+	word = (*p ^ skip) & ~((1UL << (start & 31)) - 1);
+	if (word)
+		return (start & ~31) + ffs1(word);
+	p = skip_words(p+1, (unsigned long *) addr + BITMAP_WORDS - (p+1), skip);
+	if (p >= (unsigned long *) addr + BITMAP_WORDS)
+		return 8192;
+	return ((p - (unsigned long *) addr) << 5) + ffs1(*p ^ skip);
+}
+
+#define find_zero_from(addr,start) find_bit_from((addr),(start),0)
+#define find_one_from(addr,start) find_bit_from((addr),(start),1)
+
+// 找从start开始第一段长度至少为len的连续0位，返回开始的位置，没有返回8192
+static int find_zero_run(char * addr, int start, int len)
+{
+	int end;
+
+	while ((start = find_zero_from(addr,start)) < 8192) {
+		end = find_one_from(addr,start);
+		if (end - start >= len)
+			return start;
+		start = end;
+	}
+	return 8192;
+}
+
+/*
+ * find_zero() looks for 'len' free bits in a row in one of the bitmaps,
+ * starting at 'goal' and wrapping around to the start of the map. The run
+ * doesn't cross a bitmap block. Blocks that don't have 'len' free bits
+ * left are skipped without looking at them. Returns -1 if there is no
+ * such run.
+ */
+static int find_zero(struct buffer_head ** map, unsigned short * nfree,
+	int goal, int size, int len)
+{
+	int nmaps = (size + 8191) >> 13;
+	int i, k, bit, start;
+
+	if (goal < 0 || goal >= size)
+		goal = 0;
+	// 目标所在的块要找两次：先找目标后面的部分，绕一圈后再从头找
+	for (k = 0 ; k <= nmaps ; k++) {
+		i = ((goal >> 13) + k) % nmaps;
+		if (!map[i] || nfree[i] < len)
+			continue;
+		start = k ? 0 : (goal & 8191);
+		if (len == 1)
+			bit = find_zero_from(map[i]->b_data,start);
+		else
+			bit = find_zero_run(map[i]->b_data,start,len);
+		if (bit < 8192 && (bit += i << 13) + len <= size)
+			return bit;
+	}
+	return -1;
+}
+
+// 数一个位图块中前size位里0的个数，全1和全0的字不用一位一位地数
+static int count_zero(char * addr, int size)
+{
+	unsigned long * p = (unsigned long *) addr;
+	unsigned long word;
+	int n = 0, i;
+
+	for (i = 0 ; i < size ; i += 32) {
+		word = ~*p++;
+		if (size - i < 32)
+			word &= (1UL << (size - i)) - 1;
+		else if (!word)
+			continue;
+		else if (word == 0xffffffff) {
+			n += 32;
+			continue;
+		}
+		// 每2位、4位、8位分别相加，最后把4个字节加起来
+		word -= (word >> 1) & 0x55555555;
+		word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+		word = (word + (word >> 4)) & 0x0f0f0f0f;
+		n += (word * 0x01010101) >> 24;
+	}
+	return n;
+}
+
+/*
+ * count_free() fills in the free counts of a newly read super-block.
+ * They are only a hint for the allocators: a block that says it is full
+ * is not looked at.
+ */
+void count_free(struct super_block * sb)
+{
+	int i, size;
+
+	for (i = 0 ; i < I_MAP_SLOTS ; i++) {
+		sb->s_ifree[i] = 0;
+		size = IMAP_BITS(sb) - (i << 13);
+		if (sb->s_imap[i] && size > 0)
+			sb->s_ifree[i] = count_zero(sb->s_imap[i]->b_data,
+				size > 8192 ? 8192 : size);
+	}
+	for (i = 0 ; i < Z_MAP_SLOTS ; i++) {
+		sb->s_zfree[i] = 0;
+		size = ZMAP_BITS(sb) - (i << 13);
+		if (sb->s_zmap[i] && size > 0)
+			sb->s_zfree[i] = count_zero(sb->s_zmap[i]->b_data,
+				size > 8192 ? 8192 : size);
+	}
+	sb->s_ilast = sb->s_zlast = 0;
+}
+// 把[start,start+len)的位清0，一次一个字，有位本来就是0则返回0
+static int clear_bits(char * addr, int start, int len)
+{
+	unsigned long * p = (unsigned long *) addr + (start >> 5);
+	unsigned long mask;
+	int n, ok = 1;
+
+	while (len > 0) {
+		n = 32 - (start & 31);
+		if (n > len)
+			n = len;
+		mask = (n == 32) ? ~0UL : ((1UL << n) - 1) << (start & 31);
+		if ((*p & mask) != mask)
+			ok = 0;
+		*p++ &= ~mask;
+		start += n;
+		len -= n;
+	}
+	return ok;
+}
+
+// 在数据块位图中释放[block,block+count)，可能跨几个位图块
+static void clear_zones(struct super_block * sb, int block, int count)
+{
+	int n;
+
+	block -= sb->s_firstdatazone - 1;
+	for ( ; count > 0 ; block += n, count -= n) {
+		n = 8192 - (block & 8191);
+		if (n > count)
+			n = count;
+		if (!clear_bits(sb->s_zmap[block/8192]->b_data,block&8191,n)) {
+			printk("blocks (%04x:%d-%d) ",sb->s_dev,
+				block+sb->s_firstdatazone-1,
+				block+sb->s_firstdatazone-2+n);
+			panic("free_blocks: bit already cleared");
+		}
+		// 该位图对应的buffer需要回写到硬盘，一段只标记一次
+		journal_dirty(sb->s_zmap[block/8192]);
+		sb->s_zfree[block/8192] += n;
+	}
+}
+
+/*
+ * free_blocks() frees the 'count' blocks starting at 'block'. Buffers
+ * for them that are in the cache are thrown away - the hash tells us
+ * which are, without any disk i/o - and the bits are cleared a word at a
+ * time. A block whose buffer is still in use isn't freed, as before.
+ */
+void free_blocks(int dev, int block, int count)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
+	int i, start;
 	// 超级块里存在文件系统的元数据，包括位图缓存，数据块的块数，开始块号等
 	if (!(sb = get_super(dev)))
 		panic("trying to free block on nonexistent device");
 	// 块号的范围，不小于最小，不大于最大
-	if (block < sb->s_firstdatazone || block >= sb->s_nzones)
+	if (block < sb->s_firstdatazone || block+count > sb->s_nzones)
 		panic("trying to free block not in datazone");
-	// 从缓存中获取dev设备的第block块的数据，可能需要释放
-	bh = get_hash_table(dev,block);
-	if (bh) {
-		// 还在使用
+	for (i = start = 0 ; i < count ; i++) {
+		// 不在缓存中的块什么都不用做
+		if (!(bh = get_hash_table(dev,block+i)))
+			continue;
+		// 还在使用，这一块不能释放，前面的先释放掉
 		if (bh->b_count != 1) {
 			printk("trying to free block (%04x:%d), count=%d\n",
-				dev,block,bh->b_count);
-			return;
+				dev,block+i,bh->b_count);
+			brelse(bh);
+			clear_zones(sb,block+start,i-start);
+			start = i+1;
+			continue;
 		}
 		bh->b_dirt=0;
 		bh->b_uptodate=0;
 		// 释放该buffer给其他进程使用
 		brelse(bh);
 	}
-	block -= sb->s_firstdatazone - 1 ;
-	/*
-		置为未使用状态,s_zmap保存的是硬盘数据块的位图数组，
-		每个元素管理8192个数据块的使用情况,block/8192算出该块属于哪个位图元素的管理访问，
-		然后把该元素中的地block为清0
-	*/
-	if (clear_bit(block&8191,sb->s_zmap[block/8192]->b_data)) {
-		printk("block (%04x:%d) ",dev,block+sb->s_firstdatazone-1);
-		panic("free_block: bit already cleared");
-	}
-	// 该位图对应的buffer需要回写到硬盘
-	sb->s_zmap[block/8192]->b_dirt = 1;
+	clear_zones(sb,block+start,count-start);
+}
+
+// 释放硬盘的某个块的数据，清除buffer里该数据块对应的数据，数据块位图对应的位置0，等待回写硬盘，硬盘的数据还存在
+void free_block(int dev, int block)
+{
+	free_blocks(dev,block,1);
 }
 /*
-	新建一个数据块，首先利用超级块的块位图信息找到一个可用的数据块，
-	然后读进来，清0，等待回写，返回块号
+	新建*count个连续的数据块，首先利用超级块的块位图信息找到一段可用的数据块，
+	然后把每块都清0，等待回写，返回第一块的块号，*count为实际分配的块数。
+	goal是希望分配到的块号，一般是文件中前一块的下一块，这样顺序写的文件在
+	硬盘上是连续的。goal为0则从上次分配的位置后面找。找不到这么长的一段时
+	每次减半再找，最少分配一块
 */
-int new_block(int dev)
+int new_blocks(int dev, int goal, int * count)
 {
 	struct buffer_head * bh;
 	struct super_block * sb;
-	int i,j;
+	int i,j,n;
 	// 获取文件系统的超级块信息
 	if (!(sb = get_super(dev)))
 		panic("trying to get new block from nonexistant device");
-	j = 8192;
-	// 找第一个未使用的块的位置
-	for (i=0 ; i<8 ; i++)
-		//s_zmap[i]为数据块位图的缓存 
-		if (bh=sb->s_zmap[i])
-			if ((j=find_first_zero(bh->b_data))<8192)
-				break;
-	if (i>=8 || !bh || j>=8192)
-		return 0;
-	// 置第j个数据块已使用标记
-	if (set_bit(j,bh->b_data))
-		panic("new_block: bit already set");
+	// 块号转成位图中的位置
+	if (goal >= sb->s_firstdatazone && goal < sb->s_nzones)
+		j = goal - sb->s_firstdatazone + 1;
+	else
+		j = sb->s_zlast + 1;
+	for (n = (*count > 8192) ? 8192 : *count ; ; n >>= 1) {
+		if (n < 1)
+			return 0;
+		if ((i = find_zero(sb->s_zmap,sb->s_zfree,j,ZMAP_BITS(sb),n)) >= 0)
+			break;
+	}
+	j = i;
+	bh = sb->s_zmap[j>>13];
+	// 先把位图中的位都置上，后面getblk()可能会睡眠
+	for (i = 0 ; i < n ; i++)
+		if (set_bit((j+i)&8191,bh->b_data))
+			panic("new_block: bit already set");
 	// 该位图对应的buffer需要回写
-	bh->b_dirt = 1;
-	// 位图存在多个块中，i为第i个块，每个块对应的位图管理着8192个数据块
-	j += i*8192 + sb->s_firstdatazone-1; // 算出块号
-	// 超过了最大块号
-	if (j >= sb->s_nzones)
-		return 0;
-	// 拿到一个buffer，然后清0，等待回写
-	if (!(bh=getblk(dev,j)))
-		panic("new_block: cannot get block");
-	if (bh->b_count != 1)
-		panic("new block: count is != 1");
-	// 清0防止脏数据
-	clear_block(bh->b_data);
-	// 内容是最新的
-	bh->b_uptodate = 1;
-	// 需要回写硬盘，因为新建的内容在硬盘还没有
-	bh->b_dirt = 1;
-	brelse(bh);
+	journal_dirty(bh);
+	sb->s_zfree[j>>13] -= n;
+	sb->s_zlast = j+n-1;
+	// 算出块号
+	j += sb->s_firstdatazone-1;
+	for (i = 0 ; i < n ; i++) {
+		// 拿到一个buffer，然后清0，等待回写
+		if (!(bh=getblk(dev,j+i)))
+			panic("new_block: cannot get block");
+		if (bh->b_count != 1)
+			panic("new block: count is != 1");
+		// 清0防止脏数据
+		clear_block(bh->b_data);
+		// 内容是最新的
+		bh->b_uptodate = 1;
+		// 需要回写硬盘，因为新建的内容在硬盘还没有
+		bh->b_dirt = 1;
+		brelse(bh);
+	}
+	*count = n;
 	return j;
 }
+
+int new_block(int dev, int goal)
+{
+	int count = 1;
+
+	return new_blocks(dev,goal,&count);
+}
 // 释放一个inode，把超级块中的inode位图清0，等待位图回写到硬盘，但没有清除硬盘里inode的内容
 void free_inode(struct m_inode * inode)
 {
@@ -153,36 +361,41 @@ void free_inode(struct m_inode * inode)
 		panic("nonexistent imap in superblock");
 	if (clear_bit(inode->i_num&8191,bh->b_data))
 		printk("free_inode: bit already cleared.\n\r");
-	bh->b_dirt = 1;
+	journal_dirty(bh);
+	sb->s_ifree[inode->i_num>>13]++;
 	memset(inode,0,sizeof(*inode));
 }
 
-// 新建一个node，首先获取一个inode的结构，然后把超级块的inode位图置1
-struct m_inode * new_inode(int dev)
+/*
+	新建一个node，首先获取一个inode的结构，然后把超级块的inode位图置1。
+	goal一般是父目录的inode号，同一个目录下的文件的inode就会在同一个inode块里
+*/
+struct m_inode * new_inode(int dev, int goal)
 {
 	struct m_inode * inode;
 	struct super_block * sb;
 	struct buffer_head * bh;
-	int i,j;
+	int j;
 
 	if (!(inode=get_empty_inode()))
 		return NULL;
 	if (!(sb = get_super(dev)))
 		panic("new_inode with unknown device");
-	j = 8192;
-	for (i=0 ; i<8 ; i++)
-		if (bh=sb->s_imap[i])
-			if ((j=find_first_zero(bh->b_data))<8192)
-				break;
-	if (!bh || j >= 8192 || j+i*8192 > sb->s_ninodes) {
+	inode->i_v2 = (sb->s_magic == SUPER_MAGIC_V2);
+	if (goal <= 0 || goal > sb->s_ninodes)
+		goal = sb->s_ilast;
+	if ((j = find_zero(sb->s_imap,sb->s_ifree,goal,IMAP_BITS(sb),1)) < 0) {
 		iput(inode);
 		return NULL;
 	}
+	bh = sb->s_imap[j>>13];
 	// 设置位图的地j位为1
-	if (set_bit(j,bh->b_data))
+	if (set_bit(j&8191,bh->b_data))
 		panic("new_inode: bit already set");
 	// 位图回写硬盘
-	bh->b_dirt = 1;
+	journal_dirty(bh);
+	sb->s_ifree[j>>13]--;
+	sb->s_ilast = j;
 	inode->i_count=1;
 	inode->i_nlinks=1;
 	inode->i_dev=dev;
@@ -191,7 +404,8 @@ struct m_inode * new_inode(int dev)
 	// inode的内容也需要回写硬盘
 	inode->i_dirt=1;
 	// 保存的是绝对位置，即位置落在哪个位图块的第几个位置，每个位图块是8192
-	inode->i_num = j + i*8192;
+	inode->i_num = j;
+	insert_inode_hash(inode);
 	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
 	return inode;
 }
@@ -46,8 +46,8 @@ int block_write(int dev, long * pos, char * buf, int count)
 		// 更新还需要写多少字节
 		count -= chars;
 		// 写入
-		while (chars-->0)
-			*(p++) = get_fs_byte(buf++);
+		memcpy_fromfs(p,buf,chars);
+		buf += chars;
 		bh->b_dirt = 1;
 		brelse(bh);
 	}
@@ -79,8 +79,8 @@ int block_read(int dev, unsigned long * pos, char * buf, int count)
 		read += chars;
 		count -= chars;
 		// 读入
-		while (chars-->0)
-			put_fs_byte(*(p++),buf++);
+		memcpy_tofs(buf,p,chars);
+		buf += chars;
 		brelse(bh);
 	}
 	return read;
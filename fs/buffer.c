@@ -23,6 +23,7 @@
 #include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
+#include <linux/mm.h>
 #include <asm/system.h>
 #include <asm/io.h>
 
@@ -46,48 +47,117 @@ static inline void wait_on_buffer(struct buffer_head * bh)
 	sti();
 }
 
+// 按设备号和块号排序，块数最多一页，用希尔排序就够了
+#define BEFORE(a,b) ((a)->b_dev < (b)->b_dev || \
+	((a)->b_dev == (b)->b_dev && (a)->b_blocknr < (b)->b_blocknr))
+
+void sort_buffers(struct buffer_head ** list, int n)
+{
+	struct buffer_head * bh;
+	int gap, i, j;
+
+	for (gap = 1 ; gap < n/3 ; gap = 3*gap+1)
+		/* nothing */ ;
+	for ( ; gap > 0 ; gap /= 3)
+		for (i = gap ; i < n ; i++) {
+			bh = list[i];
+			for (j = i ; j >= gap && BEFORE(bh,list[j-gap]) ; j -= gap)
+				list[j] = list[j-gap];
+			list[j] = bh;
+		}
+}
+
+#define SORT_MAX (PAGE_SIZE/sizeof(struct buffer_head *))
+
+/*
+ * Writes the dirty buffers of dev (of all devices if dev is 0) sorted
+ * by block number, a page of them at a time, so that the disk sees a few
+ * long sweeps instead of the order of the buffer cache. The buffers are
+ * held while we sleep in ll_rw_block(), so that getblk() can't give them
+ * to another block. A buffer that is locked (being read, or written
+ * while it was dirtied again) isn't skipped: the others are started first,
+ * then it is waited for and written if it is still dirty. Metadata on a
+ * device with a journal is written by journal_commit() only.
+ */
+static void write_dirty(int dev)
+{
+	struct buffer_head ** list, * bh;
+	int i, j, n;
+
+	list = (struct buffer_head **) get_free_page();
+	bh = start_buffer;
+	for (i=0 ; i<NR_BUFFERS ; ) {
+		for (n=0 ; i<NR_BUFFERS && n<SORT_MAX ; i++,bh++) {
+			if (!bh->b_dirt || (dev && bh->b_dev != dev))
+				continue;
+			if (bh->b_journal && journal_active(bh->b_dev))
+				continue;
+			// 没有内存排序就按原来的顺序写
+			if (!list) {
+				ll_rw_block(WRITE,bh);
+				continue;
+			}
+			bh->b_count++;
+			list[n++] = bh;
+		}
+		if (!n)
+			continue;
+		sort_buffers(list,n);
+		// 被锁着的先跳过，不用等的请求先都发出去
+		for (j=0 ; j<n ; j++) {
+			bh = list[j];
+			// 睡眠的时候可能变成了元数据块
+			if (!bh->b_lock &&
+			    !(bh->b_journal && journal_active(bh->b_dev)))
+				ll_rw_block(WRITE,bh);
+		}
+		// 刚才被锁着的，ll_rw_block()等它解锁，还脏的话再写
+		for (j=0 ; j<n ; j++) {
+			bh = list[j];
+			if (bh->b_dirt &&
+			    !(bh->b_journal && journal_active(bh->b_dev)))
+				ll_rw_block(WRITE,bh);
+		}
+		for (j=0 ; j<n ; j++)
+			list[j]->b_count--;
+		wake_up(&buffer_wait);
+		bh = start_buffer+i;
+	}
+	if (list)
+		free_page((unsigned long) list);
+}
+
 int sys_sync(void)
 {
 	int i;
-	struct buffer_head * bh;
 	// 把所有inode写入buffer，等待回写，见下面代码
 	sync_inodes();		/* write out inodes into buffers */
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		wait_on_buffer(bh);
-		if (bh->b_dirt)
-			// 请求底层写硬盘操作，等待底层驱动回写到硬盘，不一定立刻写入
-			ll_rw_block(WRITE,bh);
-	}
+	// 挂了日志的设备先提交日志，元数据由journal_commit()写回原处
+	for (i=0 ; i<NR_SUPER ; i++)
+		if (super_block[i].s_dev)
+			journal_commit(super_block[i].s_dev);
+	// 请求底层写硬盘操作，等待底层驱动回写到硬盘，不一定立刻写入
+	write_dirty(0);
 	return 0;
 }
 
+/*
+ * On a device with a journal, metadata buffers are only ever written by
+ * journal_commit(): the ones that are still dirty afterwards changed
+ * while the commit slept, and go into the next transaction. We may be
+ * called with locks held, so the commit is put off while a system call
+ * is in the middle of changing metadata, see journal_try_commit().
+ */
 // 把buffer中属于dev设备的缓存全部回写到硬盘
 int sync_dev(int dev)
 {
-	int i;
-	struct buffer_head * bh;
-
-	bh = start_buffer;
 	// 先把属于该dev的缓存回写硬盘
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_dirt)
-			ll_rw_block(WRITE,bh);
-	}
+	write_dirty(dev);
 	// 同步所有inode到buffer中
 	sync_inodes();
+	journal_try_commit(dev);
 	// 把属于该dev的buffer再写一次
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_dirt)
-			ll_rw_block(WRITE,bh);
-	}
+	write_dirty(dev);
 	return 0;
 }
 // 使属于dev的buffer全部失效
@@ -285,6 +355,14 @@ repeat:
 		wait_on_buffer(bh);
 		if (bh->b_count)
 			goto repeat;
+		/*
+			有句柄打开着的时候元数据提交不了，等别的buffer被释放，
+			日志的块最多JOURNAL_MAX个，总有别的buffer
+		*/
+		if (bh->b_dirt && bh->b_journal && journal_active(bh->b_dev)) {
+			sleep_on(&buffer_wait);
+			goto repeat;
+		}
 	}
 /* NOTE!! While we slept waiting for this block, somebody else might */
 /* already have added "this" block to the cache. check it */
@@ -295,6 +373,7 @@ repeat:
 	bh->b_count=1;
 	bh->b_dirt=0;
 	bh->b_uptodate=0;
+	bh->b_journal=0;
 	// 移除空闲链表
 	remove_from_queues(bh);
 	bh->b_dev=dev;
@@ -392,9 +471,9 @@ struct buffer_head * breada(int dev,int first, ...)
 	while ((first=va_arg(args,int))>=0) {
 		tmp=getblk(dev,first);
 		if (tmp) {
+			// 预读的是tmp，原来传的是bh，预读其实没有做
 			if (!tmp->b_uptodate)
-				// bh应该是tmp，因为需要每次给底层传一个新的buffer结构，如果一直用bh，预读的数据会覆盖前面的数据
-				ll_rw_block(READA,bh);
+				ll_rw_block(READA,tmp);
 			tmp->b_count--;
 		}
 	}
@@ -425,6 +504,7 @@ void buffer_init(long buffer_end)
 		h->b_count = 0;
 		h->b_lock = 0;
 		h->b_uptodate = 0;
+		h->b_journal = 0;
 		h->b_wait = NULL;
 		h->b_next = NULL;
 		h->b_prev = NULL;
@@ -0,0 +1,226 @@
+/*
+ *  linux/fs/dcache.c
+ */
+
+/*
+ * 'dcache.c' is a small cache of directory lookups, so that looking up
+ * the same path again doesn't have to read and scan the directory blocks
+ * for every component.
+ *
+ * Entries are keyed by (device, directory inode, name) and hold the inode
+ * number the name maps to. An inode number of 0 is a negative entry: the
+ * name is known not to exist. Entries are hashed for lookup and kept on
+ * an lru-list for replacement. Anything that changes a directory must
+ * invalidate the names it touches - see add_entry(), sys_unlink() and
+ * sys_rmdir() in namei.c.
+ *
+ * Names are in user space (fs), just as for find_entry(). '.' and '..'
+ * are never cached, as '..' may have to cross a mount point.
+ */
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/segment.h>
+
+#define DCACHE_SIZE 128
+#define DCACHE_HASH 61
+
+struct dir_cache_entry {
+	struct dir_cache_entry * h_next, * h_prev;	/* hash chain */
+	struct dir_cache_entry * lru_next, * lru_prev;	/* lru list */
+	unsigned short dev;
+	unsigned short dir;
+	unsigned short ino;		/* 0 for a negative entry */
+	unsigned char name_len;
+	char name[NAME_LEN];
+};
+
+static struct dir_cache_entry dcache[DCACHE_SIZE];
+static struct dir_cache_entry * hash_table[DCACHE_HASH];
+// lru链表的头是最久没有使用的项，尾是最近使用的项
+static struct dir_cache_entry * lru_head;
+
+// 把名字从用户空间复制出来，超过NAME_LEN的部分截断，返回名字的长度，.和..返回0
+static int get_name(const char * name, int len, char * buf)
+{
+	int i;
+
+	if (len > NAME_LEN)
+		len = NAME_LEN;
+	if (len <= 0)
+		return 0;
+	for (i=0 ; i<len ; i++)
+		buf[i] = get_fs_byte(name+i);
+	if (buf[0] == '.' && (len == 1 || (len == 2 && buf[1] == '.')))
+		return 0;
+	return len;
+}
+
+static inline int hashfn(int dev, int dir, const char * name, int len)
+{
+	unsigned long hash = dev ^ dir;
+
+	while (len-- > 0)
+		hash = (hash << 4) + (hash >> 28) + (unsigned char) *name++;
+	return hash % DCACHE_HASH;
+}
+
+static void remove_hash(struct dir_cache_entry * de)
+{
+	if (!de->dev)
+		return;
+	if (de->h_next)
+		de->h_next->h_prev = de->h_prev;
+	if (de->h_prev)
+		de->h_prev->h_next = de->h_next;
+	else
+		hash_table[hashfn(de->dev,de->dir,de->name,de->name_len)] = de->h_next;
+	de->h_next = de->h_prev = NULL;
+	de->dev = 0;
+}
+
+static void add_hash(struct dir_cache_entry * de)
+{
+	struct dir_cache_entry ** head;
+
+	head = hash_table + hashfn(de->dev,de->dir,de->name,de->name_len);
+	de->h_prev = NULL;
+	if ((de->h_next = *head) != NULL)
+		(*head)->h_prev = de;
+	*head = de;
+}
+
+// 移到lru链表的尾部，即最近使用
+static void touch(struct dir_cache_entry * de)
+{
+	if (de == lru_head) {
+		lru_head = de->lru_next;
+		return;
+	}
+	if (de->lru_next == lru_head)
+		return;
+	de->lru_prev->lru_next = de->lru_next;
+	de->lru_next->lru_prev = de->lru_prev;
+	de->lru_next = lru_head;
+	de->lru_prev = lru_head->lru_prev;
+	lru_head->lru_prev->lru_next = de;
+	lru_head->lru_prev = de;
+}
+
+// 废弃的项移到lru链表的头部，下次分配时最先被使用
+static void discard(struct dir_cache_entry * de)
+{
+	remove_hash(de);
+	touch(de);
+	lru_head = de;
+}
+
+static struct dir_cache_entry * find(int dev, int dir, const char * name,
+	int len)
+{
+	struct dir_cache_entry * de;
+
+	for (de = hash_table[hashfn(dev,dir,name,len)] ; de ; de = de->h_next)
+		if (de->dev == dev && de->dir == dir && de->name_len == len &&
+		    !strncmp(de->name,name,len))
+			return de;
+	return NULL;
+}
+
+/*
+ * dcache_lookup() returns 1 if the name is in the cache, with the inode
+ * number (0 if the name is known not to exist) in *ino. It returns 0 if
+ * the caller has to look at the directory itself.
+ */
+int dcache_lookup(struct m_inode * dir, const char * name, int len, int * ino)
+{
+	struct dir_cache_entry * de;
+	char buf[NAME_LEN];
+
+	if (!(len = get_name(name,len,buf)))
+		return 0;
+	if (!(de = find(dir->i_dev,dir->i_num,buf,len)))
+		return 0;
+	touch(de);
+	*ino = de->ino;
+	return 1;
+}
+
+/*
+ * 'version' is the i_dversion of dir from before the directory was
+ * searched. If it changed, the entries changed while the caller slept
+ * and its answer may already be stale, so it isn't cached. It is checked
+ * after get_name(), which may sleep too.
+ */
+void dcache_add(struct m_inode * dir, const char * name, int len, int ino,
+	unsigned short version)
+{
+	struct dir_cache_entry * de;
+	char buf[NAME_LEN];
+
+	if (!(len = get_name(name,len,buf)) || dir->i_dversion != version)
+		return;
+	if (de = find(dir->i_dev,dir->i_num,buf,len)) {
+		de->ino = ino;
+		touch(de);
+		return;
+	}
+	// 取lru链表头部最久没用的项
+	de = lru_head;
+	remove_hash(de);
+	lru_head = de->lru_next;
+	de->dev = dir->i_dev;
+	de->dir = dir->i_num;
+	de->ino = ino;
+	de->name_len = len;
+	strncpy(de->name,buf,len);
+	add_hash(de);
+}
+
+// 目录中的name被增加或删除了
+void dcache_invalidate(struct m_inode * dir, const char * name, int len)
+{
+	struct dir_cache_entry * de;
+	char buf[NAME_LEN];
+
+	if (!(len = get_name(name,len,buf)))
+		return;
+	if (de = find(dir->i_dev,dir->i_num,buf,len))
+		discard(de);
+}
+
+// 目录dir被删除了，它下面的项都没用了
+void dcache_invalidate_dir(int dev, int dir)
+{
+	int i;
+
+	for (i=0 ; i<DCACHE_SIZE ; i++)
+		if (dcache[i].dev == dev && dcache[i].dir == dir)
+			discard(dcache+i);
+}
+
+// 设备被卸载或者软盘被换掉了
+void dcache_invalidate_dev(int dev)
+{
+	int i;
+
+	for (i=0 ; i<DCACHE_SIZE ; i++)
+		if (dcache[i].dev == dev)
+			discard(dcache+i);
+}
+
+void dcache_init(void)
+{
+	int i;
+
+	for (i=0 ; i<DCACHE_HASH ; i++)
+		hash_table[i] = NULL;
+	for (i=0 ; i<DCACHE_SIZE ; i++) {
+		dcache[i].dev = 0;
+		dcache[i].h_next = dcache[i].h_prev = NULL;
+		dcache[i].lru_next = dcache + (i+1) % DCACHE_SIZE;
+		dcache[i].lru_prev = dcache + (i+DCACHE_SIZE-1) % DCACHE_SIZE;
+	}
+	lru_head = dcache;
+}
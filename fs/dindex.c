@@ -0,0 +1,299 @@
+/*
+ *  linux/fs/dindex.c
+ */
+
+/*
+ * 'dindex.c' keeps a hashed index of the entries in big directories, so
+ * that find_entry() only has to read the blocks that may hold the name,
+ * and add_entry() gets a free slot without scanning from the start.
+ *
+ * The index lives in memory only, hanging off the in-core inode. The
+ * minix directory format has no room for it: an index on disk would
+ * silently go stale the first time a kernel that doesn't know about it
+ * changed the directory. It is built the first time a directory with at
+ * least DINDEX_MIN entries is searched, and thrown away when the inode
+ * is reused or truncated, or by dindex_shrink() when memory runs out.
+ *
+ * Every directory slot has a word in the index: the low 22 bits link it
+ * to the next slot on the same hash chain (or on the free list), and the
+ * high 10 bits hold some more bits of the hash, so that most slots on a
+ * chain can be skipped without reading the block. Links are 'slot+1', 0
+ * ends a chain.
+ *
+ * Building the index sleeps. i_dversion is bumped by everything that
+ * changes the directory, and an index that was built while the directory
+ * changed is simply thrown away.
+ */
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/segment.h>
+
+#define DINDEX_MIN	(4*DIR_ENTRIES_PER_BLOCK)	/* not worth it below this */
+#define NR_BUCKETS	1024
+#define LEAF_SLOTS	1024			/* words in one leaf page */
+#define NR_LEAVES	((PAGE_SIZE-3*sizeof(long))/sizeof(long))
+
+#define LINK_MASK	0x3fffff
+#define CHECK(hash)	(((hash) >> 10) & 0x3ff)
+
+struct dir_index {
+	unsigned long free;		/* free slot list */
+	unsigned long slots;		/* nr of slots in the index */
+	unsigned long * bucket;		/* NR_BUCKETS chain heads */
+	unsigned long * leaf[NR_LEAVES];
+};
+
+#define WORD(idx,slot) ((idx)->leaf[(slot)/LEAF_SLOTS][(slot)%LEAF_SLOTS])
+
+static unsigned long hash_name(const char * name, int len)
+{
+	unsigned long hash = 0;
+
+	while (len-- > 0)
+		hash = (hash << 4) + (hash >> 28) + (unsigned char) *name++;
+	return hash ^ (hash >> 16);
+}
+
+// 名字在用户空间，和find_entry()一样
+unsigned long dindex_hash(const char * name, int len)
+{
+	char buf[NAME_LEN];
+	int i;
+
+	if (len > NAME_LEN)
+		len = NAME_LEN;
+	for (i=0 ; i<len ; i++)
+		buf[i] = get_fs_byte(name+i);
+	return hash_name(buf,len);
+}
+
+// 保证slot对应的叶子页存在
+static int add_leaf(struct dir_index * idx, unsigned long slot)
+{
+	if (slot >= NR_LEAVES*LEAF_SLOTS)
+		return 0;
+	if (!idx->leaf[slot/LEAF_SLOTS])
+		idx->leaf[slot/LEAF_SLOTS] = (unsigned long *) get_free_page();
+	return idx->leaf[slot/LEAF_SLOTS] != NULL;
+}
+
+static void free_index(struct dir_index * idx)
+{
+	int i;
+
+	for (i=0 ; i<NR_LEAVES ; i++)
+		if (idx->leaf[i])
+			free_page((unsigned long) idx->leaf[i]);
+	if (idx->bucket)
+		free_page((unsigned long) idx->bucket);
+	free_page((unsigned long) idx);
+}
+
+void dindex_free(struct m_inode * dir)
+{
+	struct dir_index * idx;
+
+	if (!(idx = dir->i_dindex))
+		return;
+	// find_indexed()睡眠回来要知道索引没了
+	dir->i_dversion++;
+	dir->i_dindex = NULL;
+	free_index(idx);
+}
+
+/*
+ * Called by get_free_page() when it has nothing left: throws away the
+ * index of one directory nobody uses (it is only cached), and returns 1
+ * if it did. Indexes of directories in use are left alone, as whoever
+ * uses them may be sleeping in the middle of something with a slot.
+ */
+int dindex_shrink(void)
+{
+	struct m_inode * inode;
+	int i;
+
+	for (i = 0, inode = inode_table ; i < nr_inodes ; i++, inode++)
+		if (inode->i_dindex && !inode->i_count) {
+			dindex_free(inode);
+			return 1;
+		}
+	return 0;
+}
+
+/*
+ * dindex_build() returns 1 if the directory has an index (building it
+ * if necessary), 0 if the caller has to scan the directory itself.
+ */
+int dindex_build(struct m_inode * dir)
+{
+	struct dir_index * idx;
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	unsigned long entries, i, n, hash, tail = 0;
+	unsigned long * head;
+	int block, len, version;
+
+	if (dir->i_dindex)
+		return 1;
+	entries = dir->i_size / (sizeof (struct dir_entry));
+	if (entries < DINDEX_MIN)
+		return 0;
+	version = dir->i_dversion;
+	// get_free_page()返回的页已经清零
+	if (!(idx = (struct dir_index *) get_free_page()))
+		return 0;
+	if (!(idx->bucket = (unsigned long *) get_free_page()))
+		goto fail;
+	for (i = 0 ; i < entries ; i += DIR_ENTRIES_PER_BLOCK) {
+		// 一块的目录项总是在同一个叶子页里
+		if (!add_leaf(idx,i))
+			goto fail;
+		bh = NULL;
+		if ((block = bmap(dir,i/DIR_ENTRIES_PER_BLOCK)) &&
+		    !(bh = bread(dir->i_dev,block)))
+			goto fail;
+		de = bh ? (struct dir_entry *) bh->b_data : NULL;
+		for (n = i ; n < i+DIR_ENTRIES_PER_BLOCK && n < entries ; n++) {
+			// 已使用的项放进散列链
+			if (de && de[n-i].inode) {
+				for (len=0 ; len<NAME_LEN && de[n-i].name[len] ; len++)
+					/* nothing */ ;
+				hash = hash_name(de[n-i].name,len);
+				head = idx->bucket + hash % NR_BUCKETS;
+				WORD(idx,n) = (CHECK(hash) << 22) | *head;
+				*head = n+1;
+				continue;
+			}
+			// 空闲的项（包括文件空洞里的）按顺序挂到空闲链表尾部
+			WORD(idx,n) = 0;
+			if (tail)
+				WORD(idx,tail-1) |= n+1;
+			else
+				idx->free = n+1;
+			tail = n+1;
+		}
+		brelse(bh);
+	}
+	idx->slots = entries;
+	// 睡眠期间目录被改了，或者别人已经建好了索引
+	if (dir->i_dindex || dir->i_dversion != version)
+		goto fail;
+	dir->i_dindex = idx;
+	return 1;
+fail:
+	free_index(idx);
+	return 0;
+}
+
+/*
+ * Returns the next slot after 'slot' (or the first one if slot < 0) that
+ * may hold a name with this hash, -1 if there are no more.
+ */
+long dindex_next(struct m_inode * dir, unsigned long hash, long slot)
+{
+	struct dir_index * idx;
+	unsigned long word;
+
+	if (!(idx = dir->i_dindex))
+		return -1;
+	word = (slot < 0) ? idx->bucket[hash % NR_BUCKETS] : WORD(idx,slot);
+	while ((slot = (long) (word & LINK_MASK) - 1) >= 0) {
+		word = WORD(idx,slot);
+		if ((word >> 22) == CHECK(hash))
+			return slot;
+	}
+	return -1;
+}
+
+/*
+ * Hands out a free slot, which the caller has to dindex_add() or give
+ * back with dindex_release(). -1 means there is no index (any more).
+ */
+long dindex_alloc(struct m_inode * dir)
+{
+	struct dir_index * idx;
+	long slot;
+
+	if (!(idx = dir->i_dindex))
+		return -1;
+	if ((slot = (long) idx->free - 1) >= 0) {
+		idx->free = WORD(idx,slot) & LINK_MASK;
+		return slot;
+	}
+	if (!add_leaf(idx,idx->slots)) {
+		dindex_free(dir);
+		return -1;
+	}
+	WORD(idx,idx->slots) = 0;
+	return idx->slots++;
+}
+
+void dindex_release(struct m_inode * dir, long slot)
+{
+	struct dir_index * idx;
+
+	if (!(idx = dir->i_dindex))
+		return;
+	WORD(idx,slot) = idx->free;
+	idx->free = slot+1;
+}
+
+// 新的目录项已经写进了slot
+void dindex_add(struct m_inode * dir, long slot, unsigned long hash)
+{
+	struct dir_index * idx;
+	unsigned long * head;
+
+	dir->i_dversion++;
+	if (!(idx = dir->i_dindex))
+		return;
+	head = idx->bucket + hash % NR_BUCKETS;
+	WORD(idx,slot) = (CHECK(hash) << 22) | *head;
+	*head = slot+1;
+}
+
+/*
+ * The entry 'de' in 'bh' has just been cleared. The name is still in
+ * it, so we can find its chain: the slot is the one on the chain that
+ * is at the same offset in the same block.
+ */
+void dindex_remove(struct m_inode * dir, struct buffer_head * bh,
+	struct dir_entry * de)
+{
+	struct dir_index * idx;
+	unsigned long hash, word, * prev;
+	long slot, offset;
+	int len, version;
+
+	dir->i_dversion++;
+	for (len=0 ; len<NAME_LEN && de->name[len] ; len++)
+		/* nothing */ ;
+	hash = hash_name(de->name,len);
+	offset = de - (struct dir_entry *) bh->b_data;
+repeat:
+	if (!(idx = dir->i_dindex))
+		return;
+	version = dir->i_dversion;
+	prev = idx->bucket + hash % NR_BUCKETS;
+	while ((slot = (long) (*prev & LINK_MASK) - 1) >= 0) {
+		word = WORD(idx,slot);
+		if ((word >> 22) == CHECK(hash) &&
+		    slot % DIR_ENTRIES_PER_BLOCK == offset) {
+			// bmap()可能会读间接块而睡眠
+			len = bmap(dir,slot/DIR_ENTRIES_PER_BLOCK);
+			if (dir->i_dversion != version || dir->i_dindex != idx)
+				goto repeat;
+			if (len == bh->b_blocknr) {
+				*prev = (*prev & ~LINK_MASK) | (word & LINK_MASK);
+				WORD(idx,slot) = idx->free;
+				idx->free = slot+1;
+				return;
+			}
+		}
+		prev = &WORD(idx,slot);
+	}
+	// 索引里没有这一项，索引已经不可信了
+	printk("dindex_remove: entry not in index\n\r");
+	dindex_free(dir);
+}
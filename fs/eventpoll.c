@@ -0,0 +1,380 @@
+/*
+ *  linux/fs/eventpoll.c
+ */
+
+/*
+ * 'eventpoll.c' implements epoll: the file descriptors are registered
+ * once with epoll_ctl(), and epoll_wait() only returns the ones that are
+ * ready. Unlike select() it doesn't look at every descriptor on every
+ * call, so its cost doesn't grow with the number of them.
+ *
+ * Every registered file has an epitem, whose select_wait entries are on
+ * the same lists that select() uses (the pipe's i_select, the tty queues).
+ * An entry without a task belongs to an epitem, and select_wake() hands
+ * it to epoll_wake(), which puts the item on the ready list. This may
+ * happen in an interrupt, so the ready list is only changed with
+ * interrupts off.
+ *
+ * epoll_wait() only polls the items on the ready list. The ones that
+ * are still ready are returned and, unless EPOLLET was asked for, go
+ * back on the list (level triggered), the others are dropped until the
+ * next wakeup. Pipes and ttys wake up when they go from empty or full,
+ * so with EPOLLET the reader has to read until EAGAIN.
+ *
+ * An epoll instance is a file on a memory inode (no device, like a pipe)
+ * whose i_epoll points to the page with the eventpoll and its items.
+ * Items are found by (file, fd); when the last reference to a file goes,
+ * sys_close() calls epoll_forget() to take it out of every instance.
+ */
+#include <errno.h>
+#include <sys/poll.h>
+#include <sys/epoll.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/select.h>
+#include <asm/segment.h>
+#include <asm/system.h>
+
+struct epitem {
+	struct eventpoll * ep;
+	struct file * file;		/* NULL if the slot is free */
+	int fd;
+	unsigned long events;
+	unsigned long data;
+	struct epitem * rd_next;	/* on the ready list */
+	int ready;
+	select_table table;
+	struct select_wait wait[2];	/* a tty has two lists */
+};
+
+struct eventpoll {
+	struct eventpoll * next;	/* all instances */
+	struct select_wait * select;	/* epoll_wait() and select() on us */
+	struct epitem * rd_head, ** rd_tail;
+	int nr;				/* items in use */
+	struct epitem item[1];
+};
+
+// 一个eventpoll占一页，剩下的都用来放epitem
+#define EP_MAX_ITEMS \
+	((PAGE_SIZE-sizeof(struct eventpoll))/sizeof(struct epitem)+1)
+
+static struct eventpoll * ep_list = NULL;
+
+// 以下两个函数要在关中断时调用
+static void ready_add(struct eventpoll * ep, struct epitem * item)
+{
+	if (item->ready)
+		return;
+	item->ready = 1;
+	item->rd_next = NULL;
+	*ep->rd_tail = item;
+	ep->rd_tail = &item->rd_next;
+}
+
+static struct epitem * ready_get(struct eventpoll * ep)
+{
+	struct epitem * item;
+
+	if (!(item = ep->rd_head))
+		return NULL;
+	if (!(ep->rd_head = item->rd_next))
+		ep->rd_tail = &ep->rd_head;
+	item->ready = 0;
+	return item;
+}
+
+static void ready_del(struct eventpoll * ep, struct epitem * item)
+{
+	struct epitem ** p;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (item->ready) {
+		for (p = &ep->rd_head ; *p != item ; p = &(*p)->rd_next)
+			/* nothing */ ;
+		if (!(*p = item->rd_next))
+			ep->rd_tail = p;
+		item->ready = 0;
+	}
+	restore_flags(flags);
+}
+
+// select_wake()里调用，可能在中断里
+void epoll_wake(struct select_wait * entry)
+{
+	struct epitem * item = entry->item;
+	struct eventpoll * ep = item->ep;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (!item->ready) {
+		ready_add(ep,item);
+		select_wake(&ep->select);
+	}
+	restore_flags(flags);
+}
+
+/*
+ * poll_file() of an epoll file: it is readable if something may be
+ * ready. Items on the ready list aren't polled again here, so this
+ * can be a false alarm, which select() users have to live with anyway.
+ */
+int epoll_poll(struct m_inode * inode, select_table * wait)
+{
+	struct eventpoll * ep = inode->i_epoll;
+
+	select_wait(&ep->select,wait);
+	return ep->rd_head ? POLLIN : 0;
+}
+
+static void remove_item(struct eventpoll * ep, struct epitem * item)
+{
+	// 先从等待链表上拿下来，之后就不会再被放到就绪链表上了
+	free_wait(&item->table);
+	ready_del(ep,item);
+	item->file = NULL;
+	ep->nr--;
+}
+
+void epoll_forget(struct file * file)
+{
+	struct eventpoll * ep;
+	int i;
+
+	for (ep = ep_list ; ep ; ep = ep->next) {
+		if (!ep->nr)
+			continue;
+		for (i = 0 ; i < EP_MAX_ITEMS ; i++)
+			if (ep->item[i].file == file)
+				remove_item(ep,ep->item+i);
+	}
+}
+
+// iput()里最后一个引用没了时调用
+void epoll_release(struct m_inode * inode)
+{
+	struct eventpoll * ep = inode->i_epoll, ** p;
+	int i;
+
+	for (i = 0 ; i < EP_MAX_ITEMS ; i++)
+		if (ep->item[i].file)
+			free_wait(&ep->item[i].table);
+	for (p = &ep_list ; *p != ep ; p = &(*p)->next)
+		/* nothing */ ;
+	*p = ep->next;
+	inode->i_epoll = NULL;
+	free_page((unsigned long) ep);
+}
+
+static struct eventpoll * get_ep(unsigned int fd)
+{
+	struct file * file;
+
+	if (fd >= NR_OPEN || !(file = current->filp[fd]) || !file->f_inode)
+		return NULL;
+	return file->f_inode->i_epoll;
+}
+
+int sys_epoll_create(int size)
+{
+	struct m_inode * inode;
+	struct eventpoll * ep;
+	struct file * f;
+	int fd, i;
+
+	if (size <= 0)
+		return -EINVAL;
+	if (!(ep = (struct eventpoll *) get_free_page()))
+		return -ENOMEM;
+	// get_empty_inode()可能睡眠，所以先拿inode再找文件描述符和file
+	if (!(inode = get_empty_inode())) {
+		free_page((unsigned long) ep);
+		return -ENFILE;
+	}
+	for (fd = 0 ; fd < NR_OPEN ; fd++)
+		if (!current->filp[fd])
+			break;
+	for (f = file_table, i = 0 ; i < NR_FILE ; i++,f++)
+		if (!f->f_count)
+			break;
+	if (fd >= NR_OPEN || i >= NR_FILE) {
+		iput(inode);
+		free_page((unsigned long) ep);
+		return fd >= NR_OPEN ? -EMFILE : -ENFILE;
+	}
+	ep->rd_tail = &ep->rd_head;
+	ep->next = ep_list;
+	ep_list = ep;
+	inode->i_epoll = ep;
+	current->filp[fd] = f;
+	current->close_on_exec &= ~(1<<fd);
+	f->f_count = 1;
+	f->f_inode = inode;
+	f->f_mode = 3;
+	f->f_flags = 0;
+	f->f_pos = 0;
+	return fd;
+}
+
+int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event * event)
+{
+	struct eventpoll * ep;
+	struct epitem * item = NULL, * p;
+	struct file * file;
+	unsigned long events = 0, data = 0, flags;
+	int i, mask;
+
+	if (!(ep = get_ep(epfd)))
+		return -EBADF;
+	if (fd >= NR_OPEN || !(file = current->filp[fd]))
+		return -EBADF;
+	// 不支持epoll套epoll
+	if (file->f_inode && file->f_inode->i_epoll)
+		return -EINVAL;
+	if (op != EPOLL_CTL_DEL) {
+		events = get_fs_long(&event->events);
+		data = get_fs_long(&event->data);
+	}
+	for (i = 0 ; i < EP_MAX_ITEMS ; i++)
+		if (ep->item[i].file == file && ep->item[i].fd == fd) {
+			item = ep->item+i;
+			break;
+		}
+	switch (op) {
+		case EPOLL_CTL_ADD:
+			if (item)
+				return -EEXIST;
+			for (p = ep->item ; p < ep->item+EP_MAX_ITEMS ; p++)
+				if (!p->file)
+					break;
+			if (p >= ep->item+EP_MAX_ITEMS)
+				return -ENOSPC;
+			item = p;
+			item->ep = ep;
+			item->file = file;
+			item->fd = fd;
+			item->ready = 0;
+			item->table.nr = 0;
+			item->table.max = 2;
+			item->table.entry = item->wait;
+			item->table.item = item;
+			ep->nr++;
+			// 挂到文件的等待链表上，以后就等它来通知了
+			mask = poll_file(file,&item->table);
+			break;
+		case EPOLL_CTL_MOD:
+			if (!item)
+				return -ENOENT;
+			mask = poll_file(file,NULL);
+			break;
+		case EPOLL_CTL_DEL:
+			if (!item)
+				return -ENOENT;
+			remove_item(ep,item);
+			return 0;
+		default:
+			return -EINVAL;
+	}
+	item->events = events;
+	item->data = data;
+	// 已经就绪的要马上放到就绪链表上，不然要等到下一次状态变化
+	if (mask & (events | POLLERR | POLLHUP)) {
+		save_flags(flags);
+		cli();
+		ready_add(ep,item);
+		restore_flags(flags);
+	}
+	return 0;
+}
+
+/*
+ * Moves what is ready to user space. Each item that was on the ready list
+ * when we started is polled once, the ones put back at the tail are left
+ * for the next call.
+ */
+static int ep_scan(struct eventpoll * ep, struct epoll_event * events,
+	int maxevents)
+{
+	struct epitem * item;
+	unsigned long flags, mask, data;
+	int nr = 0, count = 0;
+
+	save_flags(flags);
+	cli();
+	for (item = ep->rd_head ; item ; item = item->rd_next)
+		nr++;
+	restore_flags(flags);
+	while (nr-- > 0 && count < maxevents) {
+		save_flags(flags);
+		cli();
+		item = ready_get(ep);
+		restore_flags(flags);
+		if (!item)
+			break;
+		mask = poll_file(item->file,NULL) &
+			(item->events | POLLERR | POLLHUP);
+		if (!mask)
+			continue;
+		data = item->data;
+		// 水平触发的还要放回去，在put_fs_long()可能的睡眠之前做完
+		if (!(item->events & EPOLLET)) {
+			save_flags(flags);
+			cli();
+			ready_add(ep,item);
+			restore_flags(flags);
+		}
+		put_fs_long(mask,&events[count].events);
+		put_fs_long(data,&events[count].data);
+		count++;
+	}
+	return count;
+}
+
+/*
+ * timeout is in milliseconds like poll(), a negative one means wait for
+ * ever. We sleep on the select list of the instance, which epoll_wake()
+ * wakes up.
+ */
+int do_epoll_wait(int epfd, struct epoll_event * events, int maxevents,
+	long timeout)
+{
+	struct eventpoll * ep;
+	struct select_wait entry[1];
+	select_table wait;
+	int count, expire;
+
+	if (!(ep = get_ep(epfd)))
+		return -EBADF;
+	if (maxevents <= 0)
+		return -EINVAL;
+	// 一次最多也就EP_MAX_ITEMS个，大的maxevents会让下面的长度溢出
+	if (maxevents > EP_MAX_ITEMS)
+		maxevents = EP_MAX_ITEMS;
+	verify_area(events,maxevents*sizeof(struct epoll_event));
+	wait.nr = 0;
+	wait.max = 1;
+	wait.entry = entry;
+	wait.item = NULL;
+	select_wait(&ep->select,&wait);
+	expire = current->timeout = (timeout > 0) ?
+		jiffies + (timeout*HZ+999)/1000 : 0;
+	for (;;) {
+		current->state = TASK_INTERRUPTIBLE;
+		count = ep_scan(ep,events,maxevents);
+		if (count || !timeout || (current->signal & ~current->blocked) ||
+		    (expire && jiffies >= expire))
+			break;
+		schedule();
+	}
+	current->state = TASK_RUNNING;
+	current->timeout = 0;
+	free_wait(&wait);
+	if (!count && (current->signal & ~current->blocked))
+		return -EINTR;
+	return count;
+}
@@ -111,7 +111,7 @@ static unsigned long copy_strings(int argc,char ** argv,unsigned long *page,
 		unsigned long p, int from_kmem)
 {
 	char *tmp, *pag;
-	int len, offset = 0;
+	int len, n, offset = 0;
 	unsigned long old_fs, new_fs;
 
 	if (!p)
@@ -129,39 +129,35 @@ static unsigned long copy_strings(int argc,char ** argv,unsigned long *page,
 			panic("argc is wrong");
 		if (from_kmem == 1)
 			set_fs(old_fs);
-		len=0;		/* remember zero-padding */
-		// 先len++表示最后的\0，然后每次循环加一，遇到\0就退出循环，不需要加一了
-		do {
-			len++;
-		} while (get_fs_byte(tmp++));
-		// 没有空间了，p从最大空间开始减
-		if (p-len < 0) {	/* this shouldn't happen - 128kB */
+		// 长度包括最后的\0，比剩下的空间还长就没有空间了
+		len = strnlen_fs(tmp,p)+1;	/* remember zero-padding */
+		if (len > p) {	/* this shouldn't happen - 128kB */
 			set_fs(old_fs);
 			return 0;
 		}
-		
+		tmp += len;
 		while (len) {
-			// 复制全部数据过程中，每复制一个字节p减一，tmp减一代表从字符串的后面往前面复制。
-			--p; --tmp; --len;
-			// offset是页内偏移，p是整个page数组内的偏移，p初始化的时候是4096-4，后面都是4095
-			if (--offset < 0) {
-				offset = p % PAGE_SIZE;
+			// offset是当前页里p前面还能放的字节数，为0则换到前一页
+			if (!offset) {
+				offset = (p-1) % PAGE_SIZE + 1;
 				if (from_kmem==2)
 					set_fs(old_fs);
 				/*
 					从后往前复制，page的当前最后一个元素是否分配了对应的内存，
 					没有分配的话，给分配一页，如果数据少，可能只需要分配一页就够了
 				*/
-				if (!(pag = (char *) page[p/PAGE_SIZE]) &&
-				    !(pag = (char *) page[p/PAGE_SIZE] =
+				if (!(pag = (char *) page[(p-1)/PAGE_SIZE]) &&
+				    !(pag = (char *) page[(p-1)/PAGE_SIZE] =
 				      (unsigned long *) get_free_page())) 
 					return 0;
 				if (from_kmem==2)
 					set_fs(new_fs);
 
 			}
-			// 从后往前复制
-			*(pag + offset) = get_fs_byte(tmp);
+			// 从后往前，一次复制当前页里能放下的一段
+			n = (len < offset) ? len : offset;
+			p -= n; tmp -= n; len -= n; offset -= n;
+			memcpy_fromfs(pag + offset,tmp,n);
 		}
 	}
 	if (from_kmem==2)
@@ -178,7 +174,7 @@ static unsigned long change_ldt(unsigned long text_size,unsigned long * page)
 	// 4kb对齐
 	code_limit &= 0xFFFFF000;
 	// 64MB
-	data_limit = 0x4000000;
+	data_limit = TASK_SIZE;
 	// 代码段和数据段的基地址是一样的，见fork.c的copy_mem
 	code_base = get_base(current->ldt[1]);
 	data_base = code_base;
@@ -385,6 +381,8 @@ restart_interp:
 			sys_close(i);
 	// 清0
 	current->close_on_exec = 0;
+	// 新程序不知道旧程序的异步请求，上下文和占着的buffer都释放掉
+	aio_exit();
 	// 释放代码段和数据段的页表以及物理页
 	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
 	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
@@ -406,8 +404,8 @@ restart_interp:
 	current->egid = e_gid;
 	i = ex.a_text+ex.a_data;
 	// 如果代码段和数据段的长度不是4kb的倍数（即长度的低12位有值），则把没值的部分填充0
-	while (i&0xfff)
-		put_fs_byte(0,(char *) (i++));
+	if (i&0xfff)
+		memset_tofs((char *) i,PAGE_SIZE-(i&0xfff));
 	// 设置eip的值，返回后从这开始执行
 	eip[0] = ex.a_entry;		/* eip, magic happens :-) */
 	// p成为栈指针即esp
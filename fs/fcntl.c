@@ -78,6 +78,16 @@ int sys_fcntl(unsigned int fd, unsigned int cmd, unsigned long arg)
 			return 0;
 		case F_GETLK:	case F_SETLK:	case F_SETLKW:
 			return -1;
+		// 管道的容量，按页向上取整
+		case F_SETPIPE_SZ:
+			if (!filp->f_inode->i_pipe)
+				return -EINVAL;
+			return pipe_resize(filp->f_inode,arg);
+		case F_GETPIPE_SZ:
+			if (!filp->f_inode->i_pipe)
+				return -EINVAL;
+			// 环里总要空一个字节，见pipe_resize()
+			return PIPE_BUF_SIZE(*filp->f_inode)-1;
 		default:
 			return -1;
 	}
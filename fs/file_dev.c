@@ -5,7 +5,6 @@
  */
 
 #include <errno.h>
-#include <fcntl.h>
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
@@ -14,7 +13,7 @@
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
-int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
+int file_read(struct m_inode * inode, off_t * pos, char * buf, int count)
 {
 	int left,chars,nr;
 	struct buffer_head * bh;
@@ -23,27 +22,24 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 		return 0;
 	while (left) {
 		// bmap取得该文件偏移对应的硬盘块号，然后读进来
-		if (nr = bmap(inode,(filp->f_pos)/BLOCK_SIZE)) {
+		if (nr = bmap(inode,(*pos)/BLOCK_SIZE)) {
 			if (!(bh=bread(inode->i_dev,nr)))
 				break;
 		} else
 			bh = NULL;
 		// 偏移
-		nr = filp->f_pos % BLOCK_SIZE;
+		nr = *pos % BLOCK_SIZE;
 		// 读进来的数据中，可读的长度和还需要读的长度，取小的，如果还没读完继续把块从硬盘读进来
 		chars = MIN( BLOCK_SIZE-nr , left );
-		filp->f_pos += chars; // 更新偏移指针
+		*pos += chars; // 更新偏移指针
 		left -= chars; // 更新还需药读取的长度
 		if (bh) {
-			char * p = nr + bh->b_data;
-			while (chars-->0)
-				put_fs_byte(*(p++),buf++); //复制到buf里 
+			memcpy_tofs(buf,nr + bh->b_data,chars); //复制到buf里
 			brelse(bh);
-		} else {
+		} else
 			// 没有数据则复制0
-			while (chars-->0)
-				put_fs_byte(0,buf++);
-		}
+			memset_tofs(buf,chars);
+		buf += chars;
 	}
 	// 更新访问时间
 	inode->i_atime = CURRENT_TIME;
@@ -51,28 +47,40 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 	return (count-left)?(count-left):-ERROR;
 }
 
-int file_write(struct m_inode * inode, struct file * filp, char * buf, int count)
+/*
+ * O_APPEND is handled by the caller, see do_write() in read_write.c.
+ */
+int file_write(struct m_inode * inode, off_t * ppos, char * buf, int count)
 {
-	off_t pos;
-	int block,c;
+	off_t pos = *ppos;
+	int block,c,left=0,handle=0;
 	struct buffer_head * bh;
 	char * p;
 	int i=0;
 
-/*
- * ok, append may not work when many processes are writing at the same time
- * but so what. That way leads to madness anyway.
- */
-	// 如果设置了追加标记位，则更新当前位置指针到文件最后一个字节
-	if (filp->f_flags & O_APPEND)
-		pos = inode->i_size;
-	else
-		pos = filp->f_pos;
+	// 已经打开的描述符也可能指向日志文件，见open_namei()
+	if (journal_inode(inode))
+		return -ETXTBSY;
 	// i为已经写入的长度，count为需要写入的长度
 	while (i<count) {
-		// 读取一个硬盘的数据块，如果没有则创建一个块，即标记硬盘中这个块已经被使用
-		if (!(block = create_block(inode,pos/BLOCK_SIZE)))
-			break;
+		/*
+			一次映射（没有的话分配）还要写的所有块中能连续的一段，
+			这一段用完之前下一块的块号直接加一。每一段在一个日志句柄
+			里写，一段最多J_WRITE_BLOCKS块，这样句柄要的块是有数的
+		*/
+		if (!left) {
+			if (handle)
+				journal_stop();
+			left = (pos+count-i+BLOCK_SIZE-1)/BLOCK_SIZE - pos/BLOCK_SIZE;
+			if (left > J_WRITE_BLOCKS)
+				left = J_WRITE_BLOCKS;
+			journal_start(J_WRITE);
+			handle = 1;
+			if (!(block = create_blocks(inode,pos/BLOCK_SIZE,&left)))
+				break;
+		} else
+			block++;
+		left--;
 		// 然后根据返回的块号把这个块内容读进来
 		if (!(bh=bread(inode->i_dev,block)))
 			break;
@@ -88,14 +96,13 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 			inode->i_dirt = 1;
 		}
 		i += c; // 更新已经写入的长度
-		while (c-->0)
-			*(p++) = get_fs_byte(buf++);
+		memcpy_fromfs(p,buf,c);
+		buf += c;
 		brelse(bh);
 	}
-	inode->i_mtime = CURRENT_TIME;
-	if (!(filp->f_flags & O_APPEND)) {
-		filp->f_pos = pos;
-		inode->i_ctime = CURRENT_TIME;
-	}
+	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+	if (handle)
+		journal_stop();
+	*ppos = pos;
 	return (i?i:-1);
 }
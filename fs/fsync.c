@@ -0,0 +1,178 @@
+/*
+ *  linux/fs/fsync.c
+ */
+
+/*
+ * fsync() and fdatasync() write back one file, instead of everything
+ * like sync() does. The blocks of the file are found through i_zone and
+ * the indirect blocks, and the ones that are dirty in the buffer cache
+ * are written sorted by block number and then waited for together. The
+ * clean ones are waited for too, as sync() may be writing them, and a
+ * failed write of theirs is reported like one of ours.
+ *
+ * fsync() also writes the inode. fdatasync() only does when i_dirt is
+ * set, which happens when the size or the blocks change (file_write()
+ * doesn't set it for the times), as that is needed to read the data back.
+ * On a device with a journal the metadata is written by journal_commit(),
+ * after the data, so that a replayed inode never points at blocks that
+ * weren't written. Without a journal the bitmaps aren't written, an fsck
+ * finds the blocks of a file that fsync() returned for.
+ */
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/system.h>
+
+#define SYNC_MAX (PAGE_SIZE/sizeof(struct buffer_head *))
+
+struct sync_list {
+	struct buffer_head ** list;
+	int n;
+	int dev;
+	int journal;		/* metadata goes through the journal */
+	int meta;		/* dirty metadata was found */
+	int error;
+};
+
+static inline void wait_on_buffer(struct buffer_head * bh)
+{
+	cli();
+	while (bh->b_lock)
+		sleep_on(&bh->b_wait);
+	sti();
+}
+
+/*
+	排序后一起提交，再一起等。不脏的块也在表里：它可能刚被sync()写完，
+	get_hash_table()等过它，这里要看写成功没有
+*/
+static void flush_list(struct sync_list * s)
+{
+	struct buffer_head * bh;
+	int i;
+
+	sort_buffers(s->list,s->n);
+	for (i = 0 ; i < s->n ; i++)
+		if (s->list[i]->b_dirt)
+			ll_rw_block(WRITE,s->list[i]);
+	for (i = 0 ; i < s->n ; i++) {
+		bh = s->list[i];
+		wait_on_buffer(bh);
+		if (!bh->b_uptodate)
+			s->error = -EIO;
+		brelse(bh);
+	}
+	s->n = 0;
+}
+
+static void add_block(struct sync_list * s, int block, int meta)
+{
+	struct buffer_head * bh;
+
+	// 不在缓存里的块不用写也不用等
+	if (!block || !(bh = get_hash_table(s->dev,block)))
+		return;
+	// 目录块也挂在日志上，不管调用者当它是什么
+	if (bh->b_journal && s->journal)
+		meta = 1;
+	if (meta && s->journal) {
+		if (bh->b_dirt)
+			s->meta = 1;
+		brelse(bh);
+		return;
+	}
+	if (meta && bh->b_dirt)
+		s->meta = 1;
+	s->list[s->n++] = bh;
+	if (s->n >= SYNC_MAX)
+		flush_list(s);
+}
+
+// 和truncate.c的free_ind()一样，depth为1时间接块里是数据块号
+static void add_ind(struct m_inode * inode, struct sync_list * s,
+	int block, int depth)
+{
+	struct buffer_head * bh;
+	int i, zone;
+
+	if (!block || !(bh = bread(s->dev,block)))
+		return;
+	for (i = 0 ; i < ZONES_PER_BLOCK(inode) ; i++)
+		if (zone = IND_ZONE(inode,bh,i)) {
+			if (depth > 1)
+				add_ind(inode,s,zone,depth-1);
+			else
+				add_block(s,zone,0);
+		}
+	brelse(bh);
+	add_block(s,block,1);
+}
+
+static int sync_file(struct m_inode * inode, int datasync)
+{
+	struct sync_list s;
+	int i;
+
+	// 块设备文件没有自己的块，写整个设备
+	if (S_ISBLK(inode->i_mode)) {
+		sync_dev(inode->i_zone[0]);
+		return 0;
+	}
+	if (!inode->i_dev)
+		return -EINVAL;
+	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
+		return 0;
+	if (!(s.list = (struct buffer_head **) get_free_page())) {
+		sync_dev(inode->i_dev);
+		return 0;
+	}
+	s.n = 0;
+	s.dev = inode->i_dev;
+	s.journal = journal_active(inode->i_dev);
+	s.meta = 0;
+	s.error = 0;
+	for (i = 0 ; i < 7 ; i++)
+		add_block(&s,inode->i_zone[i],0);
+	for (i = 7 ; i < 10 ; i++)
+		add_ind(inode,&s,inode->i_zone[i],i-6);
+	/*
+		fsync()总要写inode（时间也要写），fdatasync()只在大小或块变了时写，
+		不过inode之前写进buffer还没写到硬盘的话也要写
+	*/
+	journal_start(J_INODE);
+	if (!datasync)
+		inode->i_dirt = 1;
+	i = sync_inode(inode);
+	journal_stop();
+	add_block(&s,i,1);
+	// 先写数据，再提交元数据
+	if (s.n)
+		flush_list(&s);
+	// 日志出错关掉了就按没有日志的设备写
+	if (s.journal && s.meta && !journal_commit(s.dev))
+		sync_dev(s.dev);
+	free_page((unsigned long) s.list);
+	return s.error;
+}
+
+static int do_fsync(unsigned int fd, int datasync)
+{
+	struct file * file;
+
+	if (fd >= NR_OPEN || !(file = current->filp[fd]) || !file->f_inode)
+		return -EBADF;
+	return sync_file(file->f_inode,datasync);
+}
+
+int sys_fsync(unsigned int fd)
+{
+	return do_fsync(fd,0);
+}
+
+int sys_fdatasync(unsigned int fd)
+{
+	return do_fsync(fd,1);
+}
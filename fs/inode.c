@@ -10,12 +10,20 @@
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <linux/mm.h>
+#include <linux/select.h>
 #include <asm/system.h>
-// 系统的inode表，整个系统的所有进程共享
-struct m_inode inode_table[NR_INODE]={{0,},};
+// 系统的inode表，整个系统的所有进程共享，启动时由inode_init()分配
+struct m_inode * inode_table;
+int nr_inodes = 0;
+static struct m_inode * hash_table[NR_IHASH];
+// 没有被引用的inode组成的循环链表，头部是最久没用的
+static struct m_inode * free_inodes = NULL;
+
+#define _hashfn(dev,nr) (((unsigned)((dev)^(nr)))%NR_IHASH)
 
 static void read_inode(struct m_inode * inode);
 static void write_inode(struct m_inode * inode);
+static int inode_block(struct super_block * sb, struct m_inode * inode);
 // 互斥访问
 static inline void wait_on_inode(struct m_inode * inode)
 {
@@ -39,19 +47,120 @@ static inline void unlock_inode(struct m_inode * inode)
 	inode->i_lock=0;
 	wake_up(&inode->i_wait);
 }
+
+/*
+ * In-core inodes are hashed on (dev,nr), and the ones nobody uses
+ * (i_count==0) are kept on an lru-list, so that they stay cached until
+ * the slot is needed for something else. Inodes without an identity
+ * (pipes, freed or invalidated inodes) go to the front of the list, as
+ * there is no point in keeping them.
+ */
+void insert_inode_hash(struct m_inode * inode)
+{
+	struct m_inode ** head = hash_table + _hashfn(inode->i_dev,inode->i_num);
+
+	if ((inode->i_hash_next = *head) != NULL)
+		(*head)->i_hash_pprev = &inode->i_hash_next;
+	*head = inode;
+	inode->i_hash_pprev = head;
+}
+
+static void remove_inode_hash(struct m_inode * inode)
+{
+	if (!inode->i_hash_pprev)
+		return;
+	if (inode->i_hash_next)
+		inode->i_hash_next->i_hash_pprev = inode->i_hash_pprev;
+	*inode->i_hash_pprev = inode->i_hash_next;
+	inode->i_hash_next = NULL;
+	inode->i_hash_pprev = NULL;
+}
+
+static struct m_inode * find_inode(int dev, int nr)
+{
+	struct m_inode * inode;
+
+	for (inode = hash_table[_hashfn(dev,nr)] ; inode ; inode = inode->i_hash_next)
+		if (inode->i_dev == dev && inode->i_num == nr)
+			return inode;
+	return NULL;
+}
+
+static void remove_free_inode(struct m_inode * inode)
+{
+	if (inode->i_free_next) {
+		if (inode->i_free_next == inode)
+			free_inodes = NULL;
+		else {
+			inode->i_free_next->i_free_prev = inode->i_free_prev;
+			inode->i_free_prev->i_free_next = inode->i_free_next;
+			if (free_inodes == inode)
+				free_inodes = inode->i_free_next;
+		}
+		inode->i_free_next = inode->i_free_prev = NULL;
+	}
+}
+
+// 放到空闲链表的尾部，first不为0则放到头部
+static void put_free_inode(struct m_inode * inode, int first)
+{
+	if (!inode->i_free_next) {
+		if (!free_inodes) {
+			inode->i_free_next = inode->i_free_prev = inode;
+			free_inodes = inode;
+		} else {
+			inode->i_free_next = free_inodes;
+			inode->i_free_prev = free_inodes->i_free_prev;
+			free_inodes->i_free_prev->i_free_next = inode;
+			free_inodes->i_free_prev = inode;
+		}
+	}
+	if (first)
+		free_inodes = inode;
+}
+
+/*
+ * inode_init() puts the inode table at mem_start, one inode for every
+ * 16kB of memory (but at least NR_INODE_MIN), and returns the number
+ * of bytes used, rounded up to a page.
+ */
+long inode_init(long mem_start, long mem_end)
+{
+	int i;
+	long size;
+
+	nr_inodes = mem_end >> 14;
+	if (nr_inodes < NR_INODE_MIN)
+		nr_inodes = NR_INODE_MIN;
+	if (nr_inodes > NR_INODE_MAX)
+		nr_inodes = NR_INODE_MAX;
+	inode_table = (struct m_inode *) mem_start;
+	size = nr_inodes * sizeof(struct m_inode);
+	memset(inode_table,0,size);
+	for (i=0 ; i<NR_IHASH ; i++)
+		hash_table[i] = NULL;
+	for (i=0 ; i<nr_inodes ; i++)
+		put_free_inode(inode_table+i,0);
+	return (size + 4095) & 0xfffff000;
+}
 // 置属于dev的inode无效
 void invalidate_inodes(int dev)
 {
 	int i;
 	struct m_inode * inode;
 
+	dcache_invalidate_dev(dev);
 	inode = 0+inode_table;
-	for(i=0 ; i<NR_INODE ; i++,inode++) {
+	for(i=0 ; i<nr_inodes ; i++,inode++) {
 		wait_on_inode(inode);
 		if (inode->i_dev == dev) {
 			if (inode->i_count)
 				printk("inode in use on removed disk\n\r");
+			remove_inode_hash(inode);
 			inode->i_dev = inode->i_dirt = 0;
+			// 没用的inode放到空闲链表头部，最先被重用
+			if (!inode->i_count)
+				put_free_inode(inode,1);
 		}
 	}
 }
@@ -62,7 +171,7 @@ void sync_inodes(void)
 	struct m_inode * inode;
 		
 	inode = 0+inode_table;
-	for(i=0 ; i<NR_INODE ; i++,inode++) {
+	for(i=0 ; i<nr_inodes ; i++,inode++) {
 		wait_on_inode(inode);
 		// 管道的内容存放在内存，所以不需要同步
 		if (inode->i_dirt && !inode->i_pipe)
@@ -70,23 +179,59 @@ void sync_inodes(void)
 	}
 }
 
+/*
+ * fsync() of one inode: puts it into its buffer like sync_inodes(), and
+ * returns the number of that block so the caller can write it.
+ */
+int sync_inode(struct m_inode * inode)
+{
+	struct super_block * sb;
+
+	wait_on_inode(inode);
+	if (inode->i_dirt && !inode->i_pipe)
+		write_inode(inode);
+	if (!(sb = get_super(inode->i_dev)))
+		return 0;
+	return inode_block(sb,inode);
+}
+
+/*
+ * Works out how many levels of indirect blocks are needed for 'block'
+ * (which has had the 7 direct blocks taken off already): 1 for the
+ * single indirect block i_zone[7], 2 for i_zone[8] and 3 for i_zone[9]
+ * (v2 only). On return *block is relative to that tree, and *span is
+ * the number of blocks covered by one entry of its top block.
+ */
+static int ind_depth(struct m_inode * inode, int * block, int * span)
+{
+	int n = ZONES_PER_BLOCK(inode);
+	int depth = 1;
+
+	*span = 1;
+	while (*block >= *span * n) {
+		*block -= *span * n;
+		*span *= n;
+		if (++depth > (inode->i_v2 ? 3 : 2))
+			panic("_bmap: block>big");
+	}
+	return depth;
+}
+
 // 找到inode中块号为block的块对应哪个硬盘块号或如果没有该块则在硬盘中新建一个块
 static int _bmap(struct m_inode * inode,int block,int create)
 {
 	struct buffer_head * bh;
-	int i;
+	int i,idx,span,depth;
 
 	if (block<0)
 		panic("_bmap: block<0");
-	// 文件的大小最大值,(7+512+512*512) * 硬盘每块的大小
-	if (block >= 7+512+512*512)
-		panic("_bmap: block>big");
 	// 块号小于7则直接在i_zone数组的前面7个中找就行
 	if (block<7) {
 		// 如果是创建模式并且该索引为空则创建一个块
 		if (create && !inode->i_zone[block])
-			// 保存块号
-			if (inode->i_zone[block]=new_block(inode->i_dev)) {
+			// 保存块号，尽量紧跟在前一块后面
+			if (inode->i_zone[block]=new_block(inode->i_dev,
+			    block ? inode->i_zone[block-1] : 0)) {
 				inode->i_ctime=CURRENT_TIME;
 				// 该inode需要回写硬盘
 				inode->i_dirt=1;
@@ -95,61 +240,34 @@ static int _bmap(struct m_inode * inode,int block,int create)
 		return inode->i_zone[block];
 	}
 	block -= 7;
-	if (block<512) {
-		if (create && !inode->i_zone[7])
-			if (inode->i_zone[7]=new_block(inode->i_dev)) {
-				inode->i_dirt=1;
-				inode->i_ctime=CURRENT_TIME;
-			}
-		if (!inode->i_zone[7])
-			return 0;
-		// 索引为7的块是间接块，需要把内容读进来才知道具体的硬盘块号
-		if (!(bh = bread(inode->i_dev,inode->i_zone[7])))
+	// i_zone[7]是一级间接块，i_zone[8]是二级，i_zone[9]是三级
+	depth = ind_depth(inode,&block,&span);
+	if (create && !inode->i_zone[6+depth])
+		if (inode->i_zone[6+depth]=new_block(inode->i_dev,
+		    depth == 1 ? inode->i_zone[6] : 0)) {
+			inode->i_dirt=1;
+			inode->i_ctime=CURRENT_TIME;
+		}
+	// 一级一级往下找，每一级的间接块中保存着下一级的块号
+	for (i = inode->i_zone[6+depth] ; i ; span /= ZONES_PER_BLOCK(inode)) {
+		if (!(bh = bread(inode->i_dev,i)))
 			return 0;
-		// 直接根据block取得对应的硬盘块号
-		i = ((unsigned short *) (bh->b_data))[block];
-		// 之前没有，新建一个块
+		idx = block / span;
+		block %= span;
+		i = IND_ZONE(inode,bh,idx);
+		// 之前没有，新建一个块，数据块尽量紧跟在前一块后面
 		if (create && !i)
-			if (i=new_block(inode->i_dev)) {
-				((unsigned short *) (bh->b_data))[block]=i;
-				bh->b_dirt=1;
+			if (i=new_block(inode->i_dev, span > 1 ? 0 : (idx ?
+			    IND_ZONE(inode,bh,idx-1) : bh->b_blocknr))) {
+				SET_IND_ZONE(inode,bh,idx,i);
+				journal_dirty(bh);
 			}
 		brelse(bh);
-		return i;
+		// 最后一级里保存的是数据块号
+		if (span == 1)
+			return i;
 	}
-	block -= 512;
-	if (create && !inode->i_zone[8])
-		if (inode->i_zone[8]=new_block(inode->i_dev)) {
-			inode->i_dirt=1;
-			inode->i_ctime=CURRENT_TIME;
-		}
-	if (!inode->i_zone[8])
-		return 0;
-	// 先取得一级索引对应的数据，数据中的每一项对应512个项
-	if (!(bh=bread(inode->i_dev,inode->i_zone[8])))
-		return 0;
-	// 每一个索引对应512个项，所以除以512，即右移9位，取得二级索引
-	i = ((unsigned short *)bh->b_data)[block>>9];
-	if (create && !i)
-		if (i=new_block(inode->i_dev)) {
-			((unsigned short *) (bh->b_data))[block>>9]=i;
-			bh->b_dirt=1;
-		}
-	brelse(bh);
-	if (!i)
-		return 0;
-	// 取得二级索引对应的数据
-	if (!(bh=bread(inode->i_dev,i)))
-		return 0;
-	// 算出偏移，最大偏移是511，所以&511
-	i = ((unsigned short *)bh->b_data)[block&511];
-	if (create && !i)
-		if (i=new_block(inode->i_dev)) {
-			((unsigned short *) (bh->b_data))[block&511]=i;
-			bh->b_dirt=1;
-		}
-	brelse(bh);
-	return i;
+	return 0;
 }
 // 查找inode中第block块对应硬盘的块号
 int bmap(struct m_inode * inode,int block)
@@ -162,6 +280,117 @@ int create_block(struct m_inode * inode, int block)
 {
 	return _bmap(inode,block,1);
 }
+
+// 间接块或者inode中的第i个块号，bh为空说明在inode中
+#define ZONE(bh,i) ((bh) ? IND_ZONE(inode,(bh),(i)) : inode->i_zone[i])
+#define SET_ZONE(bh,i,zone) do { \
+	if (bh) \
+		SET_IND_ZONE(inode,(bh),(i),(zone)); \
+	else \
+		inode->i_zone[i] = (zone); \
+} while (0)
+
+// 读入第i个块号对应的间接块，没有的话先分配一个，parent为空说明块号在inode中
+static struct buffer_head * get_ind(struct m_inode * inode,
+	struct buffer_head * parent, int i, int goal)
+{
+	int zone;
+
+	if (!(zone = ZONE(parent,i))) {
+		if (!(zone = new_block(inode->i_dev,goal)))
+			return NULL;
+		SET_ZONE(parent,i,zone);
+		if (parent)
+			journal_dirty(parent);
+		else {
+			inode->i_dirt = 1;
+			inode->i_ctime = CURRENT_TIME;
+		}
+	}
+	return bread(inode->i_dev,zone);
+}
+
+/*
+ * create_blocks() is create_block() for up to *count blocks starting at
+ * 'block'. It maps as many of them as are contiguous on disk and can be
+ * handled with the same block-number array (the inode, or one indirect
+ * block), allocating the missing ones as a single run. The first disk
+ * block is returned, and the number of blocks in the run in *count. This
+ * way a big write does one bitmap search and one indirect-block update
+ * per run instead of one per block.
+ */
+int create_blocks(struct m_inode * inode, int block, int * count)
+{
+	struct buffer_head * bh = NULL, * parent;
+	int max, n, i, goal, span, depth;
+
+	if (block<0)
+		panic("create_blocks: block<0");
+	// 找到保存block块号的数组（bh为空说明是inode中的i_zone），block为数组中的下标，max为数组中还剩几项
+	if (block<7) {
+		max = 7-block;
+		goal = block ? inode->i_zone[block-1] : 0;
+	} else {
+		block -= 7;
+		depth = ind_depth(inode,&block,&span);
+		if (!(bh = get_ind(inode,NULL,6+depth,
+		    depth == 1 ? inode->i_zone[6] : 0)))
+			return 0;
+		// 中间的间接块没有的话都要分配
+		for ( ; span > 1 ; span /= ZONES_PER_BLOCK(inode)) {
+			parent = bh;
+			bh = get_ind(inode,parent,block/span,0);
+			brelse(parent);
+			if (!bh)
+				return 0;
+			block %= span;
+		}
+		max = ZONES_PER_BLOCK(inode)-block;
+		goal = block ? IND_ZONE(inode,bh,block-1) : bh->b_blocknr;
+	}
+	if (max > *count)
+		max = *count;
+	// 已经有的块，看后面有几块在硬盘上是连续的
+	if (i = ZONE(bh,block)) {
+		for (n=1 ; n<max && ZONE(bh,block+n)==i+n ; n++)
+			/* nothing */ ;
+		brelse(bh);
+		*count = n;
+		return i;
+	}
+	// 没有的块，数一下后面有几块也没有，一起分配
+	for (n=1 ; n<max && !ZONE(bh,block+n) ; n++)
+		/* nothing */ ;
+	if (!(i = new_blocks(inode->i_dev,goal,&n))) {
+		brelse(bh);
+		return 0;
+	}
+	// new_blocks()可能睡眠，这期间别人可能已经填上了
+	if (ZONE(bh,block)) {
+		free_blocks(inode->i_dev,i,n);
+		i = ZONE(bh,block);
+		brelse(bh);
+		*count = 1;
+		return i;
+	}
+	for (max=0 ; max<n && !ZONE(bh,block+max) ; max++)
+		SET_ZONE(bh,block+max,i+max);
+	// 剩下的已经被别人填上了
+	if (n > max)
+		free_blocks(inode->i_dev,i+max,n-max);
+	if (bh)
+		journal_dirty(bh);
+	else
+		inode->i_dirt = 1;
+	inode->i_ctime = CURRENT_TIME;
+	brelse(bh);
+	*count = max;
+	return i;
+}
+
+#undef ZONE
+#undef SET_ZONE
+
 // 释放inode，如果没有被引用了，则销毁，否则引用数减一即可
 void iput(struct m_inode * inode)
 {
@@ -176,20 +405,28 @@ void iput(struct m_inode * inode)
 	if (inode->i_pipe) {
 		// 唤醒等待队列，因为该管道可能要被销毁了，不然那会使等待者无限等待，这句是不是可以放到if后
 		wake_up(&inode->i_wait);
+		// 另一端关闭了，select()的进程也要知道
+		select_wake(&inode->i_select);
 		// 引用数减一，还有进程在引用则先不销毁
 		if (--inode->i_count)
 			return;
-		// 释放管道对应的一页大小
-		free_page(inode->i_size);
+		// 释放管道的所有页
+		free_pipe_pages(inode);
 		// 该inode可以重用，因为inode指向inode_table的元素
 		inode->i_count=0;
 		inode->i_dirt=0;
 		inode->i_pipe=0;
+		put_free_inode(inode,1);
 		return;
 	}
 	// 没有dev说明不是硬盘文件对应的inode，不需要回写硬盘，引用数减一即可
 	if (!inode->i_dev) {
-		inode->i_count--;
+		if (!--inode->i_count) {
+			// epoll_create()的inode，释放它的eventpoll
+			if (inode->i_epoll)
+				epoll_release(inode);
+			put_free_inode(inode,1);
+		}
 		return;
 	}
 	if (S_ISBLK(inode->i_mode)) {
@@ -205,8 +442,19 @@ repeat:
 	}
 	// 该inode没有进程引用了，inode对应的文件也没有被其他目录项引用了，删除该inode的内容，并释放该inode
 	if (!inode->i_nlinks) {
+		// 释放文件要在日志句柄里做，开句柄可能睡眠，醒来后重新判断
+		journal_start(J_DIROP);
+		if (inode->i_count>1 || inode->i_nlinks) {
+			journal_stop();
+			goto repeat;
+		}
 		truncate(inode);
+		remove_inode_hash(inode);
 		free_inode(inode);
+		journal_stop();
+		// free_inode()把inode清零了
+		if (!inode->i_count)
+			put_free_inode(inode,1);
 		return;
 	}
 	// 需要回写硬盘，则回写
@@ -215,32 +463,31 @@ repeat:
 		wait_on_inode(inode);
 		goto repeat;
 	}
-	inode->i_count--;
+	// 不再被引用的inode继续缓存着，放到lru链表尾部
+	if (!--inode->i_count)
+		put_free_inode(inode,0);
 	return;
 }
-// 从inode表（数组）里找到一个未使用的inode结构
+// 从空闲链表中找到一个最久没用的inode结构
 struct m_inode * get_empty_inode(void)
 {
-	struct m_inode * inode;
-	static struct m_inode * last_inode = inode_table;
+	struct m_inode * inode, * p;
 	int i;
 
 	do {
 		inode = NULL;
-		for (i = NR_INODE; i ; i--) {
-			// 越界则从头再找，因为for会执行很多次，但last_inode是一直往前走
-			if (++last_inode >= inode_table + NR_INODE)
-				last_inode = inode_table;
-			// 找到一个未被使用的inode
-			if (!last_inode->i_count) {
-				// 找到未使用的并且没有被锁、数据是有效的才返回，否则先保存一个备选的
-				inode = last_inode;
-				if (!inode->i_dirt && !inode->i_lock)
+		// 从头开始找，没有被锁、数据不需要回写的最好，否则先保存一个备选的
+		if ((p = free_inodes) != NULL)
+			do {
+				if (!p->i_dirt && !p->i_lock) {
+					inode = p;
 					break;
-			}
-		}
+				}
+				if (!inode)
+					inode = p;
+			} while ((p = p->i_free_next) != free_inodes);
 		if (!inode) {
-			for (i=0 ; i<NR_INODE ; i++)
+			for (i=0 ; i<nr_inodes ; i++)
 				printk("%04x: %6d\t",inode_table[i].i_dev,
 					inode_table[i].i_num);
 			panic("No free inodes in mem");
@@ -253,6 +500,10 @@ struct m_inode * get_empty_inode(void)
 		}
 	// 找到后该inode又被引用了，继续找
 	} while (inode->i_count);
+	remove_free_inode(inode);
+	remove_inode_hash(inode);
+	// 原来的目录索引要释放，不然清零后就丢了
+	dindex_free(inode);
 	memset(inode,0,sizeof(*inode));
 	inode->i_count = 1;
 	return inode;
@@ -266,104 +517,173 @@ struct m_inode * get_pipe_inode(void)
 		return NULL;
 	// 分配一页大小的内存，首地址赋给i_size
 	if (!(inode->i_size=get_free_page())) {
-		inode->i_count = 0;
+		iput(inode);
 		return NULL;
 	}
 	inode->i_count = 2;	/* sum of readers/writers */
-	// 初始化读写指针
+	// 初始化读写指针，默认只有一页
 	PIPE_HEAD(*inode) = PIPE_TAIL(*inode) = 0;
+	PIPE_PAGES(*inode) = 1;
 	// 标记该inode是管道类型
 	inode->i_pipe = 1;
 	return inode;
 }
 
-// 在inode表中找到对应的inode节点，如果找到的是挂载的文件系统，则要查找的等于挂载点的设备和，nr为文件系统的根目录
+// 在inode哈希表中找到对应的inode节点，如果找到的是挂载的文件系统，则要查找的等于挂载点的设备和，nr为文件系统的根目录
 struct m_inode * iget(int dev,int nr)
 {
-	struct m_inode * inode, * empty;
+	struct m_inode * inode, * empty = NULL;
 
 	if (!dev)
 		panic("iget with dev==0");
-	empty = get_empty_inode();
-	inode = inode_table;
-	while (inode < NR_INODE+inode_table) {
-		// 不相等则比较下一个节点
-		if (inode->i_dev != dev || inode->i_num != nr) {
-			inode++;
-			continue;
-		}
-		wait_on_inode(inode);
-		// 阻塞的时候数据可能发生了变化，继续比较，不一样了则从头开始再找
-		if (inode->i_dev != dev || inode->i_num != nr) {
-			inode = inode_table;
-			continue;
-		}
-		inode->i_count++;
-		// 另一个文件系统挂载在该inode下
-		if (inode->i_mount) {
-			int i;
-
-			for (i = 0 ; i<NR_SUPER ; i++)
-				// 找到挂载在该inode节点的超级块结构
-				if (super_block[i].s_imount==inode)
-					break;
-			// 没找到对应的超级块，直接返回找到的inode
-			if (i >= NR_SUPER) {
-				printk("Mounted inode hasn't got sb\n");
-				if (empty)
-					iput(empty);
-				return inode;
-			}
-			iput(inode);
-			// 找到了该超级块，更新dev为该超级块的的设备号，块号为第一块，从新的起点开始找
-			dev = super_block[i].s_dev;
-			nr = ROOT_INO;
-			inode = inode_table;
-			continue;
+repeat:
+	if (!(inode = find_inode(dev,nr))) {
+		// 没有缓存，拿一个空的inode，拿的时候可能睡眠，所以拿到后要再找一次
+		if (!empty) {
+			if (!(empty = get_empty_inode()))
+				return NULL;
+			goto repeat;
 		}
-		if (empty)
-			iput(empty);
+		// 找不到则返回一个新的inode
+		inode=empty;
+		inode->i_dev = dev;
+		inode->i_num = nr;
+		insert_inode_hash(inode);
+		read_inode(inode);
 		return inode;
 	}
-	if (!empty)
-		return (NULL);
-	// 找不到则返回一个新的inode
-	inode=empty;
-	inode->i_dev = dev;
-	inode->i_num = nr;
-	read_inode(inode);
+	wait_on_inode(inode);
+	// 阻塞的时候数据可能发生了变化，不一样了则重新找
+	if (inode->i_dev != dev || inode->i_num != nr)
+		goto repeat;
+	// 本来没人用的inode要从空闲链表中摘下来
+	if (!inode->i_count++)
+		remove_free_inode(inode);
+	// 另一个文件系统挂载在该inode下
+	if (inode->i_mount) {
+		int i;
+
+		for (i = 0 ; i<NR_SUPER ; i++)
+			// 找到挂载在该inode节点的超级块结构
+			if (super_block[i].s_imount==inode)
+				break;
+		// 没找到对应的超级块，直接返回找到的inode
+		if (i >= NR_SUPER) {
+			printk("Mounted inode hasn't got sb\n");
+			if (empty)
+				iput(empty);
+			return inode;
+		}
+		iput(inode);
+		// 找到了该超级块，更新dev为该超级块的的设备号，块号为第一块，从新的起点开始找
+		dev = super_block[i].s_dev;
+		nr = ROOT_INO;
+		goto repeat;
+	}
+	if (empty)
+		iput(empty);
 	return inode;
 }
+// inode所在的硬盘块号：第一块是引导块，然后是超级块，inode位图块，数据块位图块，最后是inode节点块
+static int inode_block(struct super_block * sb, struct m_inode * inode)
+{
+	return 2 + sb->s_imap_blocks + sb->s_zmap_blocks + (inode->i_num-1) /
+		(inode->i_v2 ? V2_INODES_PER_BLOCK : INODES_PER_BLOCK);
+}
+
 // 把inode的数据从硬盘中读进来，通过超级块的信息和inode中的编号算出inode在硬盘的块号，读进来
 static void read_inode(struct m_inode * inode)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
-	int block;
+	struct d_inode * d;
+	struct d2_inode * d2;
+	int i;
 
 	lock_inode(inode);
 	if (!(sb=get_super(inode->i_dev)))
 		panic("trying to read inode without dev");
-	// 文件系统第一块是超级块，然后inode位图块，数据块块位图块，inode节点块，数据块,i_num为inode节点在硬盘inode表中编号
-	block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
-		(inode->i_num-1)/INODES_PER_BLOCK;
+	inode->i_v2 = (sb->s_magic == SUPER_MAGIC_V2);
 	// 从硬盘中把inode节点的内容读进来
-	if (!(bh=bread(inode->i_dev,block)))
+	if (!(bh=bread(inode->i_dev,inode_block(sb,inode))))
 		panic("unable to read i-node block");
 	// 读进来整个数据块，包含了要找的inode，算出inode的索引然后取值，d_inode为硬盘中的结构，m_inode为内存的结构
-	*(struct d_inode *)inode =
-		((struct d_inode *)bh->b_data)
-			[(inode->i_num-1)%INODES_PER_BLOCK]; // 取得偏移
+	if (inode->i_v2) {
+		d2 = (struct d2_inode *) bh->b_data +
+			(inode->i_num-1) % V2_INODES_PER_BLOCK;
+		inode->i_mode = d2->i_mode;
+		inode->i_uid = d2->i_uid;
+		inode->i_size = d2->i_size;
+		inode->i_mtime = d2->i_mtime;
+		inode->i_atime = d2->i_atime;
+		inode->i_ctime = d2->i_ctime;
+		inode->i_gid = d2->i_gid;
+		inode->i_nlinks = d2->i_nlinks;
+		for (i = 0 ; i < 10 ; i++)
+			inode->i_zone[i] = d2->i_zone[i];
+	} else {
+		d = (struct d_inode *) bh->b_data +
+			(inode->i_num-1) % INODES_PER_BLOCK;
+		inode->i_mode = d->i_mode;
+		inode->i_uid = d->i_uid;
+		inode->i_size = d->i_size;
+		inode->i_mtime = d->i_time;
+		inode->i_gid = d->i_gid;
+		inode->i_nlinks = d->i_nlinks;
+		for (i = 0 ; i < 9 ; i++)
+			inode->i_zone[i] = d->i_zone[i];
+		inode->i_zone[9] = 0;
+	}
 	brelse(bh);
 	unlock_inode(inode);
 }
 
-// 先把inode从硬盘中读进来，然后覆盖，等待回写
+// 把内存中的inode写到它所在的块bh里
+static void copy_inode(struct m_inode * inode, struct buffer_head * bh)
+{
+	struct d_inode * d;
+	struct d2_inode * d2;
+	int i;
+
+	if (inode->i_v2) {
+		d2 = (struct d2_inode *) bh->b_data +
+			(inode->i_num-1) % V2_INODES_PER_BLOCK;
+		d2->i_mode = inode->i_mode;
+		d2->i_uid = inode->i_uid;
+		d2->i_size = inode->i_size;
+		d2->i_mtime = inode->i_mtime;
+		d2->i_atime = inode->i_atime;
+		d2->i_ctime = inode->i_ctime;
+		d2->i_gid = inode->i_gid;
+		d2->i_nlinks = inode->i_nlinks;
+		for (i = 0 ; i < 10 ; i++)
+			d2->i_zone[i] = inode->i_zone[i];
+	} else {
+		d = (struct d_inode *) bh->b_data +
+			(inode->i_num-1) % INODES_PER_BLOCK;
+		d->i_mode = inode->i_mode;
+		d->i_uid = inode->i_uid;
+		d->i_size = inode->i_size;
+		d->i_time = inode->i_mtime;
+		d->i_gid = inode->i_gid;
+		d->i_nlinks = inode->i_nlinks;
+		for (i = 0 ; i < 9 ; i++)
+			d->i_zone[i] = inode->i_zone[i];
+	}
+	inode->i_dirt=0;
+}
+
+/*
+ * write_inode() also writes the other dirty inodes that live in the same
+ * block. They are found through the hash, so sync_inodes() reads and
+ * dirties each inode block once, not once for every inode in it.
+ */
 static void write_inode(struct m_inode * inode)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
-	int block;
+	struct m_inode * tmp;
+	int nr, first, per;
 
 	lock_inode(inode);
 	if (!inode->i_dirt || !inode->i_dev) {
@@ -372,18 +692,19 @@ static void write_inode(struct m_inode * inode)
 	}
 	if (!(sb=get_super(inode->i_dev)))
 		panic("trying to write inode without device");
-	// 算出inode的块号，2 + inode位图块数 + 块位图块数 + inode的相对偏移
-	block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
-		(inode->i_num-1)/INODES_PER_BLOCK;
 	// 读入包含该inode的整个数据块
-	if (!(bh=bread(inode->i_dev,block)))
+	if (!(bh=bread(inode->i_dev,inode_block(sb,inode))))
 		panic("unable to read i-node block");
 	// 找到数据块中inode所属的位置，写到高速缓存等待回写到硬盘
-	((struct d_inode *)bh->b_data)
-		[(inode->i_num-1)%INODES_PER_BLOCK] =
-			*(struct d_inode *)inode;
-	bh->b_dirt=1;
-	inode->i_dirt=0;
+	copy_inode(inode,bh);
+	// 同一块里其他脏的inode也顺便写进去，bread()之后不会再睡眠
+	per = inode->i_v2 ? V2_INODES_PER_BLOCK : INODES_PER_BLOCK;
+	first = (inode->i_num-1) / per * per + 1;
+	for (nr = first ; nr < first+per ; nr++)
+		if ((tmp = find_inode(inode->i_dev,nr)) && tmp != inode &&
+		    tmp->i_dirt && !tmp->i_lock)
+			copy_inode(tmp,bh);
+	journal_dirty(bh);
 	brelse(bh);
 	unlock_inode(inode);
 }
@@ -0,0 +1,675 @@
+/*
+ *  linux/fs/journal.c
+ */
+
+/*
+ * 'journal.c' keeps a write-ahead journal of the metadata of a minix
+ * filesystem: the bitmaps, inode blocks, indirect blocks and directory
+ * blocks, ie the buffers marked with journal_dirty(). After a crash the
+ * journal is replayed when the filesystem is mounted, which brings back
+ * the last committed transaction in full. Data blocks aren't journaled,
+ * so a file can still have garbage in blocks that were allocated just
+ * before the crash.
+ *
+ * The minix format has no room for a journal, so it is a plain file,
+ * '.journal' in the root directory, at least JOURNAL_BLOCKS blocks long
+ * and without holes. Something like
+ *
+ *	dd if=/dev/zero of=/.journal bs=1024 count=127
+ *
+ * does, the journal is used from the next mount on. A filesystem without
+ * it works as before. Block 0 of the file is the header, the rest are two
+ * areas that are used in turn, each a descriptor block with the block
+ * numbers followed by the copies of the blocks.
+ *
+ * System calls change metadata inside a handle (journal_start() and
+ * journal_stop()), and a commit waits until no handle is open, so that a
+ * transaction never holds half of an operation. It is then all the dirty
+ * metadata of the device, the inodes included. It is copied, written to
+ * the free area, and committed by pointing the header at it. Only then
+ * are the blocks written in place, and once they all are the header is
+ * marked clean. A block that changed again, or whose write hadn't been
+ * done, stays dirty, and as a commit takes every dirty metadata block the
+ * next transaction has it before its header replaces ours. It goes to the
+ * other area, so a committed transaction is never overwritten before
+ * another one has replaced it.
+ *
+ * A transaction can't be split, so it must fit into JOURNAL_MAX blocks:
+ * each handle says how many blocks it may dirty, and journal_start()
+ * commits first when they might not fit. If they still don't the journal
+ * is switched off, like on a write error.
+ *
+ * Transactions are committed by sync() and fsync(), by getblk() through
+ * sync_dev() when it needs a dirty buffer, and every JOURNAL_INTERVAL by
+ * the first process that returns to user mode (see ret_from_sys_call):
+ * committing sleeps, so the timer only sets journal_due. sync_dev() can
+ * be called with inodes locked, so it doesn't wait for open handles, it
+ * leaves the commit to ret_from_sys_call as well.
+ *
+ * The copies are made in private buffers that aren't in the cache, so a
+ * commit never calls getblk(), which might sync_dev() the very device we
+ * are committing.
+ */
+#include <string.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/system.h>
+
+#define JOURNAL_MAGIC	0x4c4e524a		/* "JRNL" */
+#define JOURNAL_PAGES	16
+#define JOURNAL_BUFS	(JOURNAL_PAGES*(PAGE_SIZE/BLOCK_SIZE))
+#define JOURNAL_MAX	(JOURNAL_BUFS-2)	/* minus header and descriptor */
+#define JOURNAL_BLOCKS	(1+2*(1+JOURNAL_MAX))
+#define JOURNAL_INTERVAL (5*HZ)
+
+// 第area个区在日志文件中的起始块，0块是头部
+#define AREA(area)	(1+(area)*(1+JOURNAL_MAX))
+
+#define J_CLEAN		0
+#define J_COMMITTED	1
+
+struct journal_header {
+	unsigned long h_magic;
+	unsigned long h_seq;		/* last committed transaction */
+	unsigned long h_state;		/* J_CLEAN or J_COMMITTED */
+	unsigned long h_area;		/* the area it is in */
+};
+
+struct journal_desc {
+	unsigned long d_magic;
+	unsigned long d_seq;
+	unsigned long d_count;
+	unsigned long d_block[JOURNAL_MAX];
+};
+
+struct journal {
+	struct m_inode * inode;			/* held, so it can't be freed */
+	unsigned long seq;
+	int area;
+	unsigned char lock;
+	unsigned char error;			/* write error: not used any more */
+	struct task_struct * wait;
+	unsigned long map[JOURNAL_BLOCKS];	/* journal block -> disk block */
+	struct buffer_head * meta[JOURNAL_MAX];	/* the transaction */
+	struct buffer_head log[JOURNAL_BUFS];	/* header, descriptor, copies */
+	char * page[JOURNAL_PAGES];
+};
+
+#define HEADER(j) ((struct journal_header *) (j)->log[0].b_data)
+#define DESC(j) ((struct journal_desc *) (j)->log[1].b_data)
+// 第i个块的副本
+#define COPY(j,i) ((j)->log[(i)+2].b_data)
+
+int journal_due = 0;
+static int timer_armed = 0;
+
+/*
+ * Handles. 'used' is an estimate of the dirty metadata blocks that only
+ * grows by the credits of each handle, the blocks are counted only when
+ * it gets too big.
+ */
+static int handles = 0;			/* open handles */
+static int open_credits = 0;		/* the credits of the open ones */
+static int used = 0;
+static int barrier = 0;			/* commits waiting for the handles */
+static struct task_struct * handle_wait = NULL;
+
+static inline void wait_on_buffer(struct buffer_head * bh)
+{
+	cli();
+	while (bh->b_lock)
+		sleep_on(&bh->b_wait);
+	sti();
+}
+
+// 不能用get_super()：read_super()锁着超级块的时候也会走到这里
+static struct journal * find_journal(int dev)
+{
+	struct super_block * s;
+
+	if (!dev)
+		return NULL;
+	for (s = 0+super_block ; s < NR_SUPER+super_block ; s++)
+		if (s->s_dev == dev)
+			return s->s_journal;
+	return NULL;
+}
+
+int journal_active(int dev)
+{
+	struct journal * j = find_journal(dev);
+
+	return j && !j->error;
+}
+
+/*
+	日志文件的块号在j->map[]里记着，它被截断、写或删除的话这些块会给了
+	别的文件，所以这些操作都要先问一下
+*/
+int journal_inode(struct m_inode * inode)
+{
+	struct journal * j = find_journal(inode->i_dev);
+
+	return j && j->inode == inode;
+}
+
+// 睡眠的时候日志可能被释放了，所以每次都重新找
+static struct journal * lock_journal(int dev)
+{
+	struct journal * j;
+
+	cli();
+	while ((j = find_journal(dev)) && j->lock)
+		sleep_on(&j->wait);
+	if (j)
+		j->lock = 1;
+	sti();
+	return j;
+}
+
+static void unlock_journal(struct journal * j)
+{
+	j->lock = 0;
+	wake_up(&j->wait);
+}
+
+// 事务复制好了，等着的句柄可以开始了
+static void end_barrier(void)
+{
+	if (!--barrier)
+		wake_up(&handle_wait);
+}
+
+// 私有buffer k读写日志文件的第block块
+static void log_rw(struct journal * j, int rw, int k, int block)
+{
+	struct buffer_head * bh = j->log+k;
+
+	bh->b_blocknr = j->map[block];
+	bh->b_uptodate = bh->b_dirt = (rw == WRITE);
+	ll_rw_block(rw,bh);
+}
+
+// 等私有buffer [from,to)的读写完成，都成功返回1
+static int log_wait(struct journal * j, int from, int to)
+{
+	int ok = 1;
+
+	for ( ; from < to ; from++) {
+		wait_on_buffer(j->log+from);
+		if (!j->log[from].b_uptodate)
+			ok = 0;
+	}
+	return ok;
+}
+
+static int write_header(struct journal * j, int state)
+{
+	struct journal_header * h = HEADER(j);
+
+	h->h_magic = JOURNAL_MAGIC;
+	h->h_seq = j->seq;
+	h->h_state = state;
+	h->h_area = j->area;
+	log_rw(j,WRITE,0,0);
+	return log_wait(j,0,1);
+}
+
+/*
+ * Commits one transaction, and writes its blocks in place. Returns the
+ * number of blocks in it, -1 on a write error and -2 if it doesn't fit.
+ * Called with the barrier up, which is taken down once the blocks are
+ * copied.
+ */
+static int commit_one(struct journal * j, int dev)
+{
+	struct journal_desc * d = DESC(j);
+	struct buffer_head * bh;
+	int i, n, left, area, error = 0;
+
+	// 正在读写的先等它完成，收集和复制的时候就不用睡眠了
+repeat:
+	bh = start_buffer;
+	for (i=0 ; i<NR_BUFFERS ; i++,bh++)
+		if (bh->b_dev == dev && bh->b_dirt && bh->b_journal &&
+		    bh->b_lock) {
+			wait_on_buffer(bh);
+			goto repeat;
+		}
+	// 不睡眠地收集和复制，得到的是同一时刻的元数据，一块也不能漏
+	bh = start_buffer;
+	for (i=0, n=0 ; i<NR_BUFFERS ; i++,bh++) {
+		if (bh->b_dev != dev || !bh->b_dirt || !bh->b_journal)
+			continue;
+		// 拆成两个事务的话，崩溃后可能只重放了一半
+		if (n >= JOURNAL_MAX) {
+			end_barrier();
+			for (i=0 ; i<n ; i++)
+				brelse(j->meta[i]);
+			return -2;
+		}
+		bh->b_count++;
+		j->meta[n++] = bh;
+	}
+	if (!n) {
+		end_barrier();
+		return 0;
+	}
+	// 按块号排好，写回原处的时候是顺序的
+	sort_buffers(j->meta,n);
+	for (i=0 ; i<n ; i++) {
+		memcpy(COPY(j,i),j->meta[i]->b_data,BLOCK_SIZE);
+		d->d_block[i] = j->meta[i]->b_blocknr;
+	}
+	end_barrier();
+	// 写进另一个区，当前提交的事务不能被覆盖
+	area = !j->area;
+	d->d_magic = JOURNAL_MAGIC;
+	d->d_seq = j->seq+1;
+	d->d_count = n;
+	for (i=0 ; i<n+1 ; i++)
+		log_rw(j,WRITE,i+1,AREA(area)+i);
+	if (!log_wait(j,1,n+2))
+		goto error;
+	// 头部指向新的事务，这才算提交了
+	j->seq++;
+	j->area = area;
+	if (!write_header(j,J_COMMITTED))
+		goto error;
+	for (i=0 ; i<n ; i++)
+		if (!memcmp(j->meta[i]->b_data,COPY(j,i),BLOCK_SIZE))
+			ll_rw_block(WRITE,j->meta[i]);
+	for (i=0, left=0 ; i<n ; i++) {
+		bh = j->meta[i];
+		wait_on_buffer(bh);
+		// 内存里的还是对的，留着脏的让关掉日志后的sync()去写
+		if (!bh->b_uptodate) {
+			bh->b_uptodate = 1;
+			bh->b_dirt = 1;
+			error = 1;
+		}
+		/*
+		 * Bitmaps are changed without bread(), so a block can change
+		 * even while it is being written - if it did, make sure it's
+		 * still dirty. Dirty blocks all go into the next transaction.
+		 */
+		if (memcmp(bh->b_data,COPY(j,i),BLOCK_SIZE))
+			bh->b_dirt = 1;
+		if (bh->b_dirt)
+			left++;
+		brelse(bh);
+	}
+	if (error)
+		return -1;
+	// 全部写回原处，重放已经没有意义了
+	if (!left && !write_header(j,J_CLEAN))
+		return -1;
+	return n;
+error:
+	for (i=0 ; i<n ; i++)
+		brelse(j->meta[i]);
+	return -1;
+}
+
+/*
+ * Commits the dirty metadata of dev. Returns 0 if the device has no
+ * journal (or it was switched off), and the caller has to write the
+ * metadata itself. Waits for the open handles, so the caller must not
+ * hold one, nor anything that a process holding one may wait for.
+ */
+int journal_commit(int dev)
+{
+	struct journal * j;
+	int error;
+
+	if (!journal_active(dev))
+		return 0;
+	// 新的句柄等着，打开着的都关了才开始
+	cli();
+	barrier++;
+	while (handles)
+		sleep_on(&handle_wait);
+	sti();
+	// 操作都做完了，inode也写进buffer，进到这个事务里
+	sync_inodes();
+	if (!(j = lock_journal(dev))) {
+		end_barrier();
+		return 0;
+	}
+	switch (commit_one(j,dev)) {
+		case -1:
+			printk("journal: write error on dev %04x, "
+				"journal switched off\n\r",dev);
+			j->error = 1;
+			break;
+		case -2:
+			printk("journal: transaction too big on dev %04x, "
+				"journal switched off\n\r",dev);
+			j->error = 1;
+			break;
+	}
+	error = j->error;
+	unlock_journal(j);
+	return !error;
+}
+
+// sync_dev()里调用，有句柄打开着就留给返回用户态的进程去提交
+int journal_try_commit(int dev)
+{
+	if (handles || barrier) {
+		journal_due = 1;
+		return journal_active(dev);
+	}
+	return journal_commit(dev);
+}
+
+// 挂了日志的设备中最多的块位图块数，J_ZMAP要这么多块，没有日志返回-1
+static int max_zmap(void)
+{
+	struct super_block * s;
+	int n = -1;
+
+	for (s = 0+super_block ; s < NR_SUPER+super_block ; s++)
+		if (s->s_dev && s->s_journal && s->s_zmap_blocks > n)
+			n = s->s_zmap_blocks;
+	return n;
+}
+
+// 挂了日志的设备上脏了的元数据块，脏inode写回时也要占一块
+static int count_dirty(void)
+{
+	struct buffer_head * bh = start_buffer;
+	struct m_inode * inode = inode_table;
+	int i, n = 0;
+
+	for (i=0 ; i<NR_BUFFERS ; i++,bh++)
+		if (bh->b_dirt && bh->b_journal && journal_active(bh->b_dev))
+			n++;
+	for (i=0 ; i<nr_inodes ; i++,inode++)
+		if (inode->i_dirt && !inode->i_pipe &&
+		    journal_active(inode->i_dev))
+			n++;
+	return n;
+}
+
+/*
+ * Opens a handle that may dirty 'credits' metadata blocks. It has to be
+ * called before the first change, with nothing locked: it waits while a
+ * commit collects, and commits itself if the transaction might get too
+ * big. A nested handle is covered by the outermost one, whose credits
+ * have to include it.
+ */
+void journal_start(int credits)
+{
+	struct super_block * s;
+	int zmap, committed = 0;
+
+	if (current->journal) {
+		current->journal++;
+		return;
+	}
+	zmap = max_zmap();
+	if (credits & J_ZMAP)
+		credits = (credits & ~J_ZMAP) + (zmap > 0 ? zmap : 0);
+	cli();
+	for (;;) {
+		if (!barrier) {
+			// 没有日志就不用数了
+			if (zmap < 0)
+				used = 0;
+			if (zmap < 0 || committed || used+credits <= JOURNAL_MAX)
+				break;
+			// 估计的放不下了，数一下真正脏了多少
+			used = count_dirty()+open_credits;
+			if (used+credits <= JOURNAL_MAX)
+				break;
+			// 没有打开的句柄就自己提交，等着的话谁也不会提交
+			if (!handles) {
+				sti();
+				for (s = 0+super_block ; s < NR_SUPER+super_block ; s++)
+					if (s->s_dev && s->s_journal)
+						journal_commit(s->s_dev);
+				cli();
+				used = count_dirty()+open_credits;
+				committed = 1;
+				continue;
+			}
+		}
+		sleep_on(&handle_wait);
+	}
+	handles++;
+	open_credits += credits;
+	used += credits;
+	current->journal = 1;
+	current->credits = credits;
+	sti();
+}
+
+void journal_stop(void)
+{
+	if (--current->journal)
+		return;
+	open_credits -= current->credits;
+	// 等着提交的进程，和等着提交完了再开始的进程
+	if (!--handles)
+		wake_up(&handle_wait);
+}
+
+static void journal_timer(void)
+{
+	timer_armed = 0;
+	journal_due = 1;
+}
+
+// 定时器到期或sync_dev()没能提交时，由第一个返回用户态的进程调用，见system_call.s
+void journal_run(void)
+{
+	struct super_block * s;
+	int active = 0;
+
+	journal_due = 0;
+	for (s = 0+super_block ; s < NR_SUPER+super_block ; s++)
+		if (s->s_dev && s->s_journal) {
+			journal_commit(s->s_dev);
+			active = 1;
+		}
+	if (active && !timer_armed) {
+		timer_armed = 1;
+		add_timer(JOURNAL_INTERVAL,journal_timer);
+	}
+}
+
+/*
+ * Replays the committed transaction, if there is one. Returns the number
+ * of blocks written, -1 if the journal can't be used.
+ */
+static int replay(struct journal * j, struct super_block * sb)
+{
+	struct journal_header * h = HEADER(j);
+	struct journal_desc * d = DESC(j);
+	struct buffer_head * bh;
+	int i;
+
+	log_rw(j,READ,0,0);
+	if (!log_wait(j,0,1))
+		return -1;
+	// 新建的日志文件是全0的
+	if (h->h_magic != JOURNAL_MAGIC) {
+		j->seq = j->area = 0;
+		return write_header(j,J_CLEAN) ? 0 : -1;
+	}
+	j->seq = h->h_seq;
+	j->area = h->h_area & 1;
+	if (h->h_state != J_COMMITTED)
+		return 0;
+	log_rw(j,READ,1,AREA(j->area));
+	if (!log_wait(j,1,2))
+		return -1;
+	if (d->d_magic != JOURNAL_MAGIC || d->d_seq != h->h_seq ||
+	    d->d_count > JOURNAL_MAX) {
+		printk("journal: bad descriptor on dev %04x\n\r",sb->s_dev);
+		return -1;
+	}
+	for (i=0 ; i<d->d_count ; i++)
+		if (d->d_block[i] < 2 || d->d_block[i] >= sb->s_nzones) {
+			printk("journal: bad block %d on dev %04x\n\r",
+				d->d_block[i],sb->s_dev);
+			return -1;
+		}
+	for (i=0 ; i<d->d_count ; i++)
+		log_rw(j,READ,i+2,AREA(j->area)+1+i);
+	if (!log_wait(j,2,d->d_count+2))
+		return -1;
+	// 经过缓存写回，已经读进来的位图等也就更新了
+	for (i=0 ; i<d->d_count ; i++) {
+		bh = j->meta[i] = getblk(sb->s_dev,d->d_block[i]);
+		memcpy(bh->b_data,COPY(j,i),BLOCK_SIZE);
+		bh->b_uptodate = bh->b_dirt = 1;
+		ll_rw_block(WRITE,bh);
+	}
+	for (i=0 ; i<d->d_count ; i++)
+		brelse(j->meta[i]);
+	if (!write_header(j,J_CLEAN))
+		return -1;
+	printk("journal: replayed %d blocks on dev %04x\n\r",d->d_count,
+		sb->s_dev);
+	return d->d_count;
+}
+
+// 在根目录里找.journal，返回它的inode号
+static int find_journal_ino(int dev)
+{
+	struct m_inode * dir;
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	int i, block, ino = 0;
+
+	if (!(dir = iget(dev,ROOT_INO)))
+		return 0;
+	for (i = 0 ; !ino && i*sizeof(struct dir_entry) < dir->i_size ; ) {
+		bh = NULL;
+		if ((block = bmap(dir,i/DIR_ENTRIES_PER_BLOCK)))
+			bh = bread(dev,block);
+		if (!bh) {
+			i += DIR_ENTRIES_PER_BLOCK;
+			continue;
+		}
+		de = (struct dir_entry *) bh->b_data;
+		do {
+			if (de->inode && !strncmp(de->name,".journal",NAME_LEN))
+				ino = de->inode;
+			de++;
+			i++;
+		} while (!ino && i % DIR_ENTRIES_PER_BLOCK &&
+			 i*sizeof(struct dir_entry) < dir->i_size);
+		brelse(bh);
+	}
+	iput(dir);
+	return ino;
+}
+
+static void free_journal(struct journal * j)
+{
+	int i;
+
+	for (i=0 ; i<JOURNAL_PAGES ; i++)
+		if (j->page[i])
+			free_page((unsigned long) j->page[i]);
+	free_page((unsigned long) j);
+}
+
+/*
+ * Called by read_super() for a newly read filesystem, before anybody
+ * else has looked at its inodes. Replaying can change any block, so the
+ * inodes we read to find the journal are thrown away afterwards, and the
+ * free counts are done again.
+ */
+void journal_load(struct super_block * sb)
+{
+	struct m_inode * inode;
+	struct journal * j;
+	int i, ino, n;
+
+	sb->s_journal = NULL;
+	if (!(ino = find_journal_ino(sb->s_dev)))
+		return;
+	if (!(inode = iget(sb->s_dev,ino)))
+		return;
+	if (!S_ISREG(inode->i_mode) ||
+	    inode->i_size < JOURNAL_BLOCKS*BLOCK_SIZE) {
+		printk("journal: /.journal on dev %04x needs %d blocks\n\r",
+			sb->s_dev,JOURNAL_BLOCKS);
+		iput(inode);
+		return;
+	}
+	// 最大的句柄也要能放进一个事务
+	if ((J_DIROP & ~J_ZMAP)+sb->s_zmap_blocks > JOURNAL_MAX) {
+		printk("journal: dev %04x has too many bitmap blocks\n\r",
+			sb->s_dev);
+		iput(inode);
+		return;
+	}
+	// get_free_page()返回的页已经清零，私有buffer的其他字段都是0
+	if (!(j = (struct journal *) get_free_page())) {
+		iput(inode);
+		return;
+	}
+	for (i=0 ; i<JOURNAL_BLOCKS ; i++)
+		if (!(j->map[i] = bmap(inode,i))) {
+			printk("journal: /.journal on dev %04x has holes\n\r",
+				sb->s_dev);
+			goto fail;
+		}
+	for (i=0 ; i<JOURNAL_PAGES ; i++)
+		if (!(j->page[i] = (char *) get_free_page()))
+			goto fail;
+	for (i=0 ; i<JOURNAL_BUFS ; i++) {
+		j->log[i].b_data = j->page[i/(PAGE_SIZE/BLOCK_SIZE)] +
+			(i%(PAGE_SIZE/BLOCK_SIZE))*BLOCK_SIZE;
+		j->log[i].b_dev = sb->s_dev;
+	}
+	iput(inode);
+	if ((n = replay(j,sb)) < 0) {
+		free_journal(j);
+		return;
+	}
+	if (n) {
+		invalidate_inodes(sb->s_dev);
+		sb->s_imap[0]->b_data[0] |= 1;
+		sb->s_zmap[0]->b_data[0] |= 1;
+		count_free(sb);
+	}
+	if (!(j->inode = iget(sb->s_dev,ino))) {
+		free_journal(j);
+		return;
+	}
+	sb->s_journal = j;
+	if (!timer_armed) {
+		timer_armed = 1;
+		add_timer(JOURNAL_INTERVAL,journal_timer);
+	}
+	return;
+fail:
+	iput(inode);
+	free_journal(j);
+}
+
+/*
+ * Called by put_super(). On umount sys_umount() has already committed
+ * everything; a changed floppy has to lose what wasn't committed.
+ */
+void journal_release(struct super_block * sb)
+{
+	struct journal * j;
+
+	if (!(j = lock_journal(sb->s_dev)))
+		return;
+	sb->s_journal = NULL;
+	// 等着的进程醒来后找不到日志，直接返回
+	unlock_journal(j);
+	iput(j->inode);
+	free_journal(j);
+}
@@ -78,6 +78,51 @@ static int match(int len,const char * name,struct dir_entry * de)
 	return same;
 }
 
+/*
+ * find_indexed() is the part of find_entry() for directories that have a
+ * hashed index. If the directory changes while we sleep on a block, the
+ * slot we are at may have been moved to another chain, so we start over.
+ */
+static struct buffer_head * find_indexed(struct m_inode * dir,
+	const char * name, int namelen, struct dir_entry ** res_dir)
+{
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	unsigned long hash;
+	long slot, nr;
+	int block, version;
+
+	hash = dindex_hash(name,namelen);
+repeat:
+	bh = NULL;
+	nr = -1;
+	version = dir->i_dversion;
+	for (slot = dindex_next(dir,hash,-1) ; slot >= 0 ;
+	     slot = dindex_next(dir,hash,slot)) {
+		// 和上一个候选项不在同一块则读入新的块
+		if (!bh || nr != slot/DIR_ENTRIES_PER_BLOCK) {
+			brelse(bh);
+			bh = NULL;
+			nr = slot/DIR_ENTRIES_PER_BLOCK;
+			if ((block = bmap(dir,nr)))
+				bh = bread(dir->i_dev,block);
+			if (dir->i_dversion != version) {
+				brelse(bh);
+				goto repeat;
+			}
+			if (!bh)
+				continue;
+		}
+		de = slot % DIR_ENTRIES_PER_BLOCK + (struct dir_entry *) bh->b_data;
+		if (match(namelen,name,de)) {
+			*res_dir = de;
+			return bh;
+		}
+	}
+	brelse(bh);
+	return NULL;
+}
+
 /*
  *	find_entry()
  *
@@ -134,6 +179,9 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
 			}
 		}
 	}
+	// 大目录有散列索引，只需要读可能含有该名字的块
+	if (dindex_build(*dir))
+		return find_indexed(*dir,name,namelen,res_dir);
 	// 取出该目录在硬盘中对应的第一块数据块，然后读进来
 	if (!(block = (*dir)->i_zone[0]))
 		return NULL;
@@ -187,6 +235,7 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 	const char * name, int namelen, struct dir_entry ** res_dir)
 {
 	int block,i;
+	long slot;
 	struct buffer_head * bh;
 	struct dir_entry * de;
 
@@ -200,6 +249,39 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 #endif
 	if (!namelen)
 		return NULL;
+	// 有散列索引的话直接拿一个空闲的项
+	if (dindex_build(dir) && (slot = dindex_alloc(dir)) >= 0) {
+		if (!(block = create_block(dir,slot/DIR_ENTRIES_PER_BLOCK)) ||
+		    !(bh = bread(dir->i_dev,block))) {
+			dindex_release(dir,slot);
+			return NULL;
+		}
+		de = slot % DIR_ENTRIES_PER_BLOCK + (struct dir_entry *) bh->b_data;
+		if (slot*sizeof(struct dir_entry) >= dir->i_size) {
+			de->inode=0;
+			dir->i_size = (slot+1)*sizeof(struct dir_entry);
+			dir->i_dirt = 1;
+			dir->i_ctime = CURRENT_TIME;
+		}
+		if (!de->inode) {
+			dir->i_mtime = CURRENT_TIME;
+			memcpy_fromfs(de->name,name,namelen);
+			memset(de->name+namelen,0,NAME_LEN-namelen);
+			journal_dirty(bh);
+			/*
+				名字马上就存在了，缓存中的否定项要作废。要在复制名字之后，
+				复制时睡眠期间lookup()加的否定项也要清掉，之后不会再睡眠
+				（名字所在的页刚刚读过）直到i_dversion加一
+			*/
+			dcache_invalidate(dir,name,namelen);
+			dindex_add(dir,slot,dindex_hash(name,namelen));
+			*res_dir = de;
+			return bh;
+		}
+		// 索引说是空闲的项却被用了，索引不可信，扔掉后按老办法找
+		brelse(bh);
+		dindex_free(dir);
+	}
 	if (!(block = dir->i_zone[0]))
 		return NULL;
 	if (!(bh = bread(dir->i_dev,block)))
@@ -232,9 +314,13 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 		// 在每一块中找第一项还没使用的目录项
 		if (!de->inode) {
 			dir->i_mtime = CURRENT_TIME;
-			for (i=0; i < NAME_LEN ; i++)
-				de->name[i]=(i<namelen)?get_fs_byte(name+i):0;
-			bh->b_dirt = 1;
+			memcpy_fromfs(de->name,name,namelen);
+			memset(de->name+namelen,0,NAME_LEN-namelen);
+			journal_dirty(bh);
+			dcache_invalidate(dir,name,namelen);
+			// 没有经过索引加的项，万一有索引（睡眠时别人建的）也已经不对了
+			dir->i_dversion++;
+			dindex_free(dir);
 			*res_dir = de;
 			return bh;
 		}
@@ -245,6 +331,47 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 	return NULL;
 }
 
+/*
+ *	lookup()
+ *
+ * returns the inode number of 'name' in the directory, or 0 if it doesn't
+ * exist. The directory blocks are only read if the name cache doesn't
+ * already know the answer. Like find_entry(), this may change *dir when
+ * following '..' over a mount-point.
+ *
+ * find_entry() sleeps, and an add_entry() or unlink of the same name
+ * during that sleep invalidates the cache before we get to add the old
+ * answer. Every change of the entries bumps i_dversion, so the answer
+ * is only cached if it didn't change (and we are still in the same dir),
+ * see dcache_add().
+ */
+static int lookup(struct m_inode ** dir, const char * name, int namelen)
+{
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	struct m_inode * old_dir;
+	unsigned short version;
+	int ino;
+
+#ifdef NO_TRUNCATE
+	if (namelen > NAME_LEN)
+		return 0;
+#endif
+	if (dcache_lookup(*dir,name,namelen,&ino))
+		return ino;
+	old_dir = *dir;
+	version = old_dir->i_dversion;
+	if (!(bh = find_entry(dir,name,namelen,&de)))
+		ino = 0;
+	else {
+		ino = de->inode;
+		brelse(bh);
+	}
+	if (*dir == old_dir)
+		dcache_add(*dir,name,namelen,ino,version);
+	return ino;
+}
+
 /*
  *	get_dir()
  *
@@ -257,9 +384,7 @@ static struct m_inode * get_dir(const char * pathname)
 	char c;
 	const char * thisname;
 	struct m_inode * inode;
-	struct buffer_head * bh;
 	int namelen,inr,idev;
-	struct dir_entry * de;
 
 	if (!current->root || !current->root->i_count)
 		panic("No root inode");
@@ -289,14 +414,11 @@ static struct m_inode * get_dir(const char * pathname)
 		if (!c)
 			return inode;
 		// 在inode节点下查找，thisname为当前级的目录名，namelen为当前级目录名长度
-		if (!(bh = find_entry(&inode,thisname,namelen,&de))) {
+		if (!(inr = lookup(&inode,thisname,namelen))) {
 			iput(inode);
 			return NULL;
 		}
-		// 找到当前目录对应的dir_entry结构，
-		inr = de->inode;
 		idev = inode->i_dev;
-		brelse(bh);
 		iput(inode);
 		// 取出设备中inode号为inr的目录项数据
 		if (!(inode = iget(idev,inr)))
@@ -344,22 +466,17 @@ struct m_inode * namei(const char * pathname)
 	const char * basename;
 	int inr,dev,namelen;
 	struct m_inode * dir;
-	struct buffer_head * bh;
-	struct dir_entry * de;
 	// 找到pathname最后一级目录的inode和解析出路径中的文件名
 	if (!(dir = dir_namei(pathname,&namelen,&basename)))
 		return NULL;
 	if (!namelen)			/* special case: '/usr/' etc */
 		return dir;
-	// 在最后一级目录中查找basename的文件名的目录项，存在de中
-	bh = find_entry(&dir,basename,namelen,&de);
-	if (!bh) {
+	// 在最后一级目录中查找basename的文件名对应的inode号
+	if (!(inr = lookup(&dir,basename,namelen))) {
 		iput(dir);
 		return NULL;
 	}
-	inr = de->inode;
 	dev = dir->i_dev;
-	brelse(bh);
 	iput(dir);
 	// 读取设备dev中inode节点号为inr的inode结构
 	dir=iget(dev,inr);
@@ -400,9 +517,9 @@ int open_namei(const char * pathname, int flag, int mode,
 		iput(dir);
 		return -EISDIR;
 	}
-	// 从最后一级目录的目录项中查找等于basename的目录项，存储到de中
-	bh = find_entry(&dir,basename,namelen,&de);
-	if (!bh) {
+	// 从最后一级目录的目录项中查找等于basename的目录项对应的inode号
+	inr = lookup(&dir,basename,namelen);
+	if (!inr) {
 		if (!(flag & O_CREAT)) {
 			iput(dir);
 			return -ENOENT;
@@ -411,7 +528,7 @@ int open_namei(const char * pathname, int flag, int mode,
 			iput(dir);
 			return -EACCES;
 		}
-		inode = new_inode(dir->i_dev);
+		inode = new_inode(dir->i_dev,dir->i_num);
 		if (!inode) {
 			iput(dir);
 			return -ENOSPC;
@@ -428,15 +545,13 @@ int open_namei(const char * pathname, int flag, int mode,
 		}
 		// 保存新建的inode节点的节点号
 		de->inode = inode->i_num;
-		bh->b_dirt = 1;
+		journal_dirty(bh);
 		brelse(bh);
 		iput(dir);
 		*res_inode = inode;
 		return 0;
 	}
-	inr = de->inode;
 	dev = dir->i_dev;
-	brelse(bh);
 	iput(dir);
 	// O_EXCL表示该文件必须是由当前进程创建
 	if (flag & O_EXCL)
@@ -449,6 +564,11 @@ int open_namei(const char * pathname, int flag, int mode,
 		iput(inode);
 		return -EPERM;
 	}
+	// 日志文件只能读
+	if ((flag & O_ACCMODE) && journal_inode(inode)) {
+		iput(inode);
+		return -ETXTBSY;
+	}
 	inode->i_atime = CURRENT_TIME;
 	if (flag & O_TRUNC)
 		truncate(inode);
@@ -456,7 +576,7 @@ int open_namei(const char * pathname, int flag, int mode,
 	return 0;
 }
 
-int sys_mknod(const char * filename, int mode, int dev)
+static int do_mknod(const char * filename, int mode, int dev)
 {
 	const char * basename;
 	int namelen;
@@ -476,13 +596,11 @@ int sys_mknod(const char * filename, int mode, int dev)
 		iput(dir);
 		return -EPERM;
 	}
-	bh = find_entry(&dir,basename,namelen,&de);
-	if (bh) {
-		brelse(bh);
+	if (lookup(&dir,basename,namelen)) {
 		iput(dir);
 		return -EEXIST;
 	}
-	inode = new_inode(dir->i_dev);
+	inode = new_inode(dir->i_dev,dir->i_num);
 	if (!inode) {
 		iput(dir);
 		return -ENOSPC;
@@ -500,14 +618,14 @@ int sys_mknod(const char * filename, int mode, int dev)
 		return -ENOSPC;
 	}
 	de->inode = inode->i_num;
-	bh->b_dirt = 1;
+	journal_dirty(bh);
 	iput(dir);
 	iput(inode);
 	brelse(bh);
 	return 0;
 }
 
-int sys_mkdir(const char * pathname, int mode)
+static int do_mkdir(const char * pathname, int mode)
 {
 	const char * basename;
 	int namelen;
@@ -527,13 +645,16 @@ int sys_mkdir(const char * pathname, int mode)
 		iput(dir);
 		return -EPERM;
 	}
-	bh = find_entry(&dir,basename,namelen,&de);
-	if (bh) {
-		brelse(bh);
+	if (lookup(&dir,basename,namelen)) {
 		iput(dir);
 		return -EEXIST;
 	}
-	inode = new_inode(dir->i_dev);
+	// 子目录的..会让父目录的链接数加一
+	if (dir->i_nlinks >= MAX_LINKS(dir)) {
+		iput(dir);
+		return -EMLINK;
+	}
+	inode = new_inode(dir->i_dev,dir->i_num);
 	if (!inode) {
 		iput(dir);
 		return -ENOSPC;
@@ -541,7 +662,7 @@ int sys_mkdir(const char * pathname, int mode)
 	inode->i_size = 32;
 	inode->i_dirt = 1;
 	inode->i_mtime = inode->i_atime = CURRENT_TIME;
-	if (!(inode->i_zone[0]=new_block(inode->i_dev))) {
+	if (!(inode->i_zone[0]=new_block(inode->i_dev,dir->i_zone[0]))) {
 		iput(dir);
 		inode->i_nlinks--;
 		iput(inode);
@@ -562,7 +683,7 @@ int sys_mkdir(const char * pathname, int mode)
 	de->inode = dir->i_num;
 	strcpy(de->name,"..");
 	inode->i_nlinks = 2;
-	dir_block->b_dirt = 1;
+	journal_dirty(dir_block);
 	brelse(dir_block);
 	inode->i_mode = I_DIRECTORY | (mode & 0777 & ~current->umask);
 	inode->i_dirt = 1;
@@ -576,7 +697,7 @@ int sys_mkdir(const char * pathname, int mode)
 		return -ENOSPC;
 	}
 	de->inode = inode->i_num;
-	bh->b_dirt = 1;
+	journal_dirty(bh);
 	dir->i_nlinks++;
 	dir->i_dirt = 1;
 	iput(dir);
@@ -634,7 +755,7 @@ static int empty_dir(struct m_inode * inode)
 	return 1;
 }
 
-int sys_rmdir(const char * name)
+static int do_rmdir(const char * name)
 {
 	const char * basename;
 	int namelen;
@@ -698,8 +819,11 @@ int sys_rmdir(const char * name)
 	if (inode->i_nlinks != 2)
 		printk("empty directory has nlink!=2 (%d)",inode->i_nlinks);
 	de->inode = 0;
-	bh->b_dirt = 1;
+	journal_dirty(bh);
+	dindex_remove(dir,bh,de);
 	brelse(bh);
+	dcache_invalidate(dir,basename,namelen);
+	dcache_invalidate_dir(inode->i_dev,inode->i_num);
 	inode->i_nlinks=0;
 	inode->i_dirt=1;
 	dir->i_nlinks--;
@@ -710,7 +834,7 @@ int sys_rmdir(const char * name)
 	return 0;
 }
 // 删除硬链接
-int sys_unlink(const char * name)
+static int do_unlink(const char * name)
 {
 	const char * basename;
 	int namelen;
@@ -759,6 +883,12 @@ int sys_unlink(const char * name)
 		brelse(bh);
 		return -EPERM;
 	}
+	if (journal_inode(inode)) {
+		iput(inode);
+		iput(dir);
+		brelse(bh);
+		return -EBUSY;
+	}
 	// 为0说明不在文件树中
 	if (!inode->i_nlinks) {
 		printk("Deleting nonexistent file (%04x:%d), %d\n",
@@ -768,8 +898,10 @@ int sys_unlink(const char * name)
 	// 解除了引用，inode置为0
 	de->inode = 0;
 	// 需要回写硬盘
-	bh->b_dirt = 1;
+	journal_dirty(bh);
+	dindex_remove(dir,bh,de);
 	brelse(bh);
+	dcache_invalidate(dir,basename,namelen);
 	// 引用数减一，在iput中会删除引用数为0的文件
 	inode->i_nlinks--;
 	inode->i_dirt = 1;
@@ -779,7 +911,7 @@ int sys_unlink(const char * name)
 	return 0;
 }
 // 创建硬链接
-int sys_link(const char * oldname, const char * newname)
+static int do_link(const char * oldname, const char * newname)
 {
 	struct dir_entry * de;
 	struct m_inode * oldinode, * dir;
@@ -821,11 +953,13 @@ int sys_link(const char * oldname, const char * newname)
 		iput(oldinode);
 		return -EACCES;
 	}
-	// 在目录下找文件名等于basename的项
-	bh = find_entry(&dir,basename,namelen,&de);
-	// 找到的话说明文件名已经存在，则不能再创建
-	if (bh) {
-		brelse(bh);
+	if (oldinode->i_nlinks >= MAX_LINKS(oldinode)) {
+		iput(dir);
+		iput(oldinode);
+		return -EMLINK;
+	}
+	// 在目录下找文件名等于basename的项，找到的话说明文件名已经存在，则不能再创建
+	if (lookup(&dir,basename,namelen)) {
 		iput(dir);
 		iput(oldinode);
 		return -EEXIST;
@@ -841,7 +975,7 @@ int sys_link(const char * oldname, const char * newname)
 	// 硬链接的inode和旧文件的inode号一样
 	de->inode = oldinode->i_num;
 	// 新增了一项，需要回写硬盘
-	bh->b_dirt = 1;	
+	journal_dirty(bh);	
 	brelse(bh);
 	iput(dir);
 	// 引用数加1，创建硬链接即多了一个索引指向inode节点，所以inode引用数加一即可，为0才能删除文件
@@ -852,3 +986,57 @@ int sys_link(const char * oldname, const char * newname)
 	iput(oldinode);
 	return 0;
 }
+
+/*
+ * The system calls that change directories do it inside a journal
+ * handle, so that a commit never gets half of one, see fs/journal.c.
+ */
+int sys_mknod(const char * filename, int mode, int dev)
+{
+	int error;
+
+	journal_start(J_DIROP);
+	error = do_mknod(filename,mode,dev);
+	journal_stop();
+	return error;
+}
+
+int sys_mkdir(const char * pathname, int mode)
+{
+	int error;
+
+	journal_start(J_DIROP);
+	error = do_mkdir(pathname,mode);
+	journal_stop();
+	return error;
+}
+
+int sys_rmdir(const char * name)
+{
+	int error;
+
+	journal_start(J_DIROP);
+	error = do_rmdir(name);
+	journal_stop();
+	return error;
+}
+
+int sys_unlink(const char * name)
+{
+	int error;
+
+	journal_start(J_DIROP);
+	error = do_unlink(name);
+	journal_stop();
+	return error;
+}
+
+int sys_link(const char * oldname, const char * newname)
+{
+	int error;
+
+	journal_start(J_DIROP);
+	error = do_link(oldname,newname);
+	journal_stop();
+	return error;
+}
@@ -14,11 +14,30 @@
 #include <linux/sched.h>
 #include <linux/tty.h>
 #include <linux/kernel.h>
+#include <linux/select.h>
 #include <asm/segment.h>
 
+// 返回已挂载设备的空闲块数和空闲inode数，直接用超级块中每个位图块的空闲计数
 int sys_ustat(int dev, struct ustat * ubuf)
 {
-	return -ENOSYS;
+	struct super_block * sb;
+	unsigned long tfree = 0, tinode = 0;
+	int i;
+
+	if (!(sb = get_super(dev)))
+		return -EINVAL;
+	for (i = 0 ; i < Z_MAP_SLOTS ; i++)
+		tfree += sb->s_zfree[i];
+	for (i = 0 ; i < I_MAP_SLOTS ; i++)
+		tinode += sb->s_ifree[i];
+	verify_area(ubuf,sizeof (*ubuf));
+	put_fs_long(tfree,(unsigned long *) &ubuf->f_tfree);
+	put_fs_word(tinode,(short *) &ubuf->f_tinode);
+	for (i = 0 ; i < 6 ; i++) {
+		put_fs_byte(0,ubuf->f_fname+i);
+		put_fs_byte(0,ubuf->f_fpack+i);
+	}
+	return 0;
 }
 
 int sys_utime(char * filename, struct utimbuf * times)
@@ -33,9 +52,11 @@ int sys_utime(char * filename, struct utimbuf * times)
 		modtime = get_fs_long((unsigned long *) &times->modtime);
 	} else
 		actime = modtime = CURRENT_TIME;
+	journal_start(J_INODE);
 	inode->i_atime = actime;
 	inode->i_mtime = modtime;
 	inode->i_dirt = 1;
+	journal_stop();
 	iput(inode);
 	return 0;
 }
@@ -119,8 +140,10 @@ int sys_chmod(const char * filename,int mode)
 		iput(inode);
 		return -EACCES;
 	}
+	journal_start(J_INODE);
 	inode->i_mode = (mode & 07777) | (inode->i_mode & ~07777);
 	inode->i_dirt = 1;
+	journal_stop();
 	iput(inode);
 	return 0;
 }
@@ -137,9 +160,11 @@ int sys_chown(const char * filename,int uid,int gid)
 		return -EACCES;
 	}
 	// 修改字段
+	journal_start(J_INODE);
 	inode->i_uid=uid;
 	inode->i_gid=gid;
 	inode->i_dirt=1;
+	journal_stop();
 	iput(inode);
 	return 0;
 }
@@ -167,8 +192,13 @@ int sys_open(const char * filename,int flag,int mode)
 		return -EINVAL;
 	// 引用数加一
 	(current->filp[fd]=f)->f_count++;
-	// 找到文件对应的inode节点，inode为文件对应的inode节点
-	if ((i=open_namei(filename,flag,mode,&inode))<0) {
+	// 找到文件对应的inode节点，inode为文件对应的inode节点，创建和截断在日志句柄里做
+	if (flag & (O_CREAT|O_TRUNC))
+		journal_start(J_DIROP);
+	i=open_namei(filename,flag,mode,&inode);
+	if (flag & (O_CREAT|O_TRUNC))
+		journal_stop();
+	if (i<0) {
 		current->filp[fd]=NULL;
 		f->f_count=0;
 		return i;
@@ -228,6 +258,8 @@ int sys_close(unsigned int fd)
 	// file结构引用数减一，非0说明还有其他进程或描述符在使用该结构，所以还不能释放file和inode
 	if (--filp->f_count)
 		return (0);
+	// 该文件不会再有事件了，从所有epoll里去掉
+	epoll_forget(filp);
 	// 没有进程使用了则释放该inode或需要回写到硬盘
 	iput(filp->f_inode);
 	return (0);
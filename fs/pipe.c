@@ -5,25 +5,51 @@
  */
 
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
 
 #include <linux/sched.h>
 #include <linux/mm.h>	/* for get_free_page */
+#include <linux/select.h>
 #include <asm/segment.h>
-// 负数二进制等于正数的二进制除了最高位的其他位取反加1
-int read_pipe(struct m_inode * inode, char * buf, int count)
+
+/*
+ * Readers only sleep on an empty pipe and writers on a full one, so the
+ * other side is only woken when the pipe stops being empty or full, and
+ * only once per read() or write(), not for every piece copied. A reader
+ * that empties a full pipe has to wake the writers before it sleeps
+ * itself, or both would wait forever. select() and poll() wait for the
+ * same two conditions, so they are woken at the same places.
+ */
+static void pipe_wake(struct m_inode * inode)
+{
+	wake_up(&inode->i_wait);
+	select_wake(&inode->i_select);
+}
+
+int read_pipe(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
-	int chars, size, read = 0;
+	int chars, size, read = 0, was_full = 0;
 
 	while (count>0) {
 		// 判断能读的字节数
 		while (!(size=PIPE_SIZE(*inode))) {
-			wake_up(&inode->i_wait);
+			if (was_full) {
+				pipe_wake(inode);
+				was_full = 0;
+			}
 			if (inode->i_count != 2) /* are there any writers? */
 				return read;
+			// 非阻塞模式下读到一些就返回，一点没读到返回EAGAIN
+			if (filp->f_flags & O_NONBLOCK)
+				return read?read:-EAGAIN;
 			sleep_on(&inode->i_wait);
 		}
-		// 这一次最多能读的数量
-		chars = PAGE_SIZE-PIPE_TAIL(*inode);
+		if (size == PIPE_BUF_SIZE(*inode)-1)
+			was_full = 1;
+		// 这一次最多能读到当前页的末尾
+		chars = PAGE_SIZE-PIPE_TAIL(*inode)%PAGE_SIZE;
 		// 比较能读和要读的数量，取小的
 		if (chars > count)
 			chars = count;
@@ -33,31 +59,42 @@ int read_pipe(struct m_inode * inode, char * buf, int count)
 		count -= chars;
 		read += chars;
 		size = PIPE_TAIL(*inode);
-		PIPE_TAIL(*inode) += chars;
-		PIPE_TAIL(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			put_fs_byte(((char *)inode->i_size)[size++],buf++);
+		PIPE_TAIL(*inode) = (size+chars) % PIPE_BUF_SIZE(*inode);
+		// 复制时可能缺页睡眠，这期间pipe_resize()不能释放这一页
+		PIPE_BUSY(*inode)++;
+		memcpy_tofs(buf,(char *)PIPE_PAGE(*inode,size/PAGE_SIZE)+
+			size%PAGE_SIZE,chars);
+		PIPE_BUSY(*inode)--;
+		buf += chars;
 	}
-	wake_up(&inode->i_wait);
+	if (was_full)
+		pipe_wake(inode);
 	return read;
 }
 	
-int write_pipe(struct m_inode * inode, char * buf, int count)
+int write_pipe(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
-	int chars, size, written = 0;
-	// 每次循环是以从head写到最后一个节点为单位，如果head后面都可写，则全写，如果后面只有部分可写，则通过size做了限制
+	int chars, size, written = 0, was_empty = 0;
+	// 每次循环最多写到当前页的末尾，如果只有部分可写，则通过size做了限制
 	while (count>0) {
 		// 还能写多少字节
-		while (!(size=(PAGE_SIZE-1)-PIPE_SIZE(*inode))) {
-			wake_up(&inode->i_wait);
+		while (!(size=(PIPE_BUF_SIZE(*inode)-1)-PIPE_SIZE(*inode))) {
+			if (was_empty) {
+				pipe_wake(inode);
+				was_empty = 0;
+			}
 			if (inode->i_count != 2) { /* no readers */
 				current->signal |= (1<<(SIGPIPE-1));
 				return written?written:-1;
 			}
+			if (filp->f_flags & O_NONBLOCK)
+				return written?written:-EAGAIN;
 			sleep_on(&inode->i_wait);
 		}
-		// 从head开始到最后一个字节，还能写多少字节
-		chars = PAGE_SIZE-PIPE_HEAD(*inode);
+		if (PIPE_EMPTY(*inode))
+			was_empty = 1;
+		// 从head开始到当前页的末尾，还能写多少字节
+		chars = PAGE_SIZE-PIPE_HEAD(*inode)%PAGE_SIZE;
 		// 这一次能写的比需要写的多，则取需要写的数量
 		if (chars > count)
 			chars = count;
@@ -69,18 +106,79 @@ int write_pipe(struct m_inode * inode, char * buf, int count)
 		written += chars;
 		// 指向可写的首地址
 		size = PIPE_HEAD(*inode);
-		// 更新可写的首地址
-		PIPE_HEAD(*inode) += chars;
-		// 越界则从头开始
-		PIPE_HEAD(*inode) &= (PAGE_SIZE-1);
-		// 复制这一次能写的字节
-		while (chars-->0)
-			((char *)inode->i_size)[size++]=get_fs_byte(buf++);
+		// 更新可写的首地址，越界则从头开始
+		PIPE_HEAD(*inode) = (size+chars) % PIPE_BUF_SIZE(*inode);
+		// 复制这一次能写的字节，可能缺页睡眠，和读一样要挡住pipe_resize()
+		PIPE_BUSY(*inode)++;
+		memcpy_fromfs((char *)PIPE_PAGE(*inode,size/PAGE_SIZE)+
+			size%PAGE_SIZE,buf,chars);
+		PIPE_BUSY(*inode)--;
+		buf += chars;
 	}
-	wake_up(&inode->i_wait);
+	if (was_empty)
+		pipe_wake(inode);
 	return written;
 }
 
+void free_pipe_pages(struct m_inode * inode)
+{
+	int i;
+
+	for (i=0 ; i<PIPE_PAGES(*inode) ; i++)
+		free_page(PIPE_PAGE(*inode,i));
+}
+
+/*
+ * pipe_resize() changes the capacity of a pipe to at least 'size' bytes.
+ * A ring of n pages holds n*PAGE_SIZE-1 bytes (head==tail means empty),
+ * and that is what is returned, like F_GETPIPE_SZ does. The data in the
+ * pipe is copied to the start of the new pages, and has to fit. Nothing
+ * here sleeps, but a reader or writer may be asleep in the middle of a
+ * copy from the old pages, so then we return EBUSY.
+ */
+int pipe_resize(struct m_inode * inode, unsigned long size)
+{
+	unsigned long page[PIPE_MAX_PAGES];
+	int nr, i, chars, tail, used;
+
+	if (size >= PIPE_MAX_PAGES*PAGE_SIZE)
+		return -EINVAL;
+	nr = size/PAGE_SIZE+1;
+	if (nr == PIPE_PAGES(*inode))
+		return nr*PAGE_SIZE-1;
+	used = PIPE_SIZE(*inode);
+	if (used >= nr*PAGE_SIZE || PIPE_BUSY(*inode))
+		return -EBUSY;
+	for (i=0 ; i<nr ; i++)
+		if (!(page[i] = get_free_page())) {
+			while (i-- > 0)
+				free_page(page[i]);
+			return -ENOMEM;
+		}
+	// 把管道里的数据按顺序复制到新页的开头
+	tail = PIPE_TAIL(*inode);
+	for (i=0 ; i<used ; i += chars) {
+		chars = PAGE_SIZE-tail%PAGE_SIZE;
+		if (chars > PAGE_SIZE-i%PAGE_SIZE)
+			chars = PAGE_SIZE-i%PAGE_SIZE;
+		if (chars > used-i)
+			chars = used-i;
+		memcpy((char *)page[i/PAGE_SIZE]+i%PAGE_SIZE,
+			(char *)PIPE_PAGE(*inode,tail/PAGE_SIZE)+tail%PAGE_SIZE,chars);
+		tail = (tail+chars) % PIPE_BUF_SIZE(*inode);
+	}
+	free_pipe_pages(inode);
+	inode->i_size = page[0];
+	for (i=1 ; i<nr ; i++)
+		inode->i_zone[2+i] = page[i];
+	PIPE_PAGES(*inode) = nr;
+	PIPE_TAIL(*inode) = 0;
+	PIPE_HEAD(*inode) = used;
+	// 管道变大了，等着写的进程可以继续
+	pipe_wake(inode);
+	return nr*PAGE_SIZE-1;
+}
+
 int sys_pipe(unsigned long * fildes)
 {
 	struct m_inode * inode;
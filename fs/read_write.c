@@ -5,7 +5,9 @@
  */
 
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
 
 #include <linux/kernel.h>
@@ -13,15 +15,19 @@
 #include <asm/segment.h>
 
 extern int rw_char(int rw,int dev, char * buf, int count, off_t * pos);
-extern int read_pipe(struct m_inode * inode, char * buf, int count);
-extern int write_pipe(struct m_inode * inode, char * buf, int count);
+extern int read_pipe(struct m_inode * inode, struct file * filp,
+		char * buf, int count);
+extern int write_pipe(struct m_inode * inode, struct file * filp,
+		char * buf, int count);
 extern int block_read(int dev, off_t * pos, char * buf, int count);
 extern int block_write(int dev, off_t * pos, char * buf, int count);
-extern int file_read(struct m_inode * inode, struct file * filp,
+extern int file_read(struct m_inode * inode, off_t * pos,
 		char * buf, int count);
-extern int file_write(struct m_inode * inode, struct file * filp,
+extern int file_write(struct m_inode * inode, off_t * pos,
 		char * buf, int count);
 
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
 int sys_lseek(unsigned int fd,off_t offset, int origin)
 {
 	struct file * file;
@@ -54,55 +60,232 @@ int sys_lseek(unsigned int fd,off_t offset, int origin)
 	return file->f_pos;
 }
 
-int sys_read(unsigned int fd,char * buf,int count)
+/*
+ * do_read() and do_write() are the guts of read() and write(), working at
+ * *pos instead of the file position, so that pread() and pwrite() can use
+ * them too. The caller has checked the file descriptor and the count.
+ */
+static int do_read(struct file * file, char * buf, int count, off_t * pos)
 {
-	struct file * file;
-	struct m_inode * inode;
+	struct m_inode * inode = file->f_inode;
 
-	if (fd>=NR_OPEN || count<0 || !(file=current->filp[fd]))
-		return -EINVAL;
-	if (!count)
-		return 0;
-	verify_area(buf,count);
-	inode = file->f_inode;
 	// 该文件描述符对应的是一个管道文件，并且是读端则读管道
 	if (inode->i_pipe)
-		return (file->f_mode&1)?read_pipe(inode,buf,count):-EIO;
+		return (file->f_mode&1)?read_pipe(inode,file,buf,count):-EIO;
 	if (S_ISCHR(inode->i_mode))
-		return rw_char(READ,inode->i_zone[0],buf,count,&file->f_pos);
+		return rw_char(READ,inode->i_zone[0],buf,count,pos);
 	if (S_ISBLK(inode->i_mode))
-		return block_read(inode->i_zone[0],&file->f_pos,buf,count);
+		return block_read(inode->i_zone[0],pos,buf,count);
 	if (S_ISDIR(inode->i_mode) || S_ISREG(inode->i_mode)) {
 		// 读的长度不能大于剩下的可读长度
-		if (count+file->f_pos > inode->i_size)
-			count = inode->i_size - file->f_pos;
+		if (count+*pos > inode->i_size)
+			count = inode->i_size - *pos;
 		// 到底了
 		if (count<=0)
 			return 0;
-		return file_read(inode,file,buf,count);
+		return file_read(inode,pos,buf,count);
 	}
 	printk("(Read)inode->i_mode=%06o\n\r",inode->i_mode);
 	return -EINVAL;
 }
 
+static int do_write(struct file * file, char * buf, int count, off_t * pos)
+{
+	struct m_inode * inode = file->f_inode;
+	off_t tmp;
+
+	if (inode->i_pipe)
+		return (file->f_mode&2)?write_pipe(inode,file,buf,count):-EIO;
+	if (S_ISCHR(inode->i_mode))
+		return rw_char(WRITE,inode->i_zone[0],buf,count,pos);
+	if (S_ISBLK(inode->i_mode))
+		return block_write(inode->i_zone[0],pos,buf,count);
+	if (S_ISREG(inode->i_mode)) {
+/*
+ * ok, append may not work when many processes are writing at the same time
+ * but so what. That way leads to madness anyway.
+ */
+		// 追加写从文件末尾开始，并且不改变位置指针
+		if (file->f_flags & O_APPEND) {
+			tmp = inode->i_size;
+			return file_write(inode,&tmp,buf,count);
+		}
+		return file_write(inode,pos,buf,count);
+	}
+	printk("(Write)inode->i_mode=%06o\n\r",inode->i_mode);
+	return -EINVAL;
+}
+
+int sys_read(unsigned int fd,char * buf,int count)
+{
+	struct file * file;
+
+	if (fd>=NR_OPEN || count<0 || !(file=current->filp[fd]))
+		return -EINVAL;
+	if (!count)
+		return 0;
+	verify_area(buf,count);
+	return do_read(file,buf,count,&file->f_pos);
+}
+
 int sys_write(unsigned int fd,char * buf,int count)
 {
 	struct file * file;
-	struct m_inode * inode;
 	
 	if (fd>=NR_OPEN || count <0 || !(file=current->filp[fd]))
 		return -EINVAL;
 	if (!count)
 		return 0;
-	inode=file->f_inode;
-	if (inode->i_pipe)
-		return (file->f_mode&2)?write_pipe(inode,buf,count):-EIO;
-	if (S_ISCHR(inode->i_mode))
-		return rw_char(WRITE,inode->i_zone[0],buf,count,&file->f_pos);
-	if (S_ISBLK(inode->i_mode))
-		return block_write(inode->i_zone[0],&file->f_pos,buf,count);
-	if (S_ISREG(inode->i_mode))
-		return file_write(inode,file,buf,count);
-	printk("(Write)inode->i_mode=%06o\n\r",inode->i_mode);
-	return -EINVAL;
+	return do_write(file,buf,count,&file->f_pos);
+}
+
+/*
+ * readv() and writev() do one read or write for each piece, and stop at
+ * the first one that comes up short. An error is only returned if nothing
+ * was transferred at all.
+ */
+static int do_rw_vec(int rw, unsigned int fd, struct iovec * iov, int iovcnt)
+{
+	struct file * file;
+	char * base;
+	int len, done = 0, res;
+
+	if (fd>=NR_OPEN || !(file=current->filp[fd]))
+		return -EBADF;
+	if (iovcnt < 0 || iovcnt > UIO_MAXIOV)
+		return -EINVAL;
+	for ( ; iovcnt-- > 0 ; iov++) {
+		base = (char *) get_fs_long((unsigned long *) &iov->iov_base);
+		len = (int) get_fs_long((unsigned long *) &iov->iov_len);
+		if (len < 0)
+			return done?done:-EINVAL;
+		if (!len)
+			continue;
+		if (rw == READ) {
+			verify_area(base,len);
+			res = do_read(file,base,len,&file->f_pos);
+		} else
+			res = do_write(file,base,len,&file->f_pos);
+		if (res < 0)
+			return done?done:res;
+		done += res;
+		if (res < len)
+			break;
+	}
+	return done;
+}
+
+int sys_readv(unsigned int fd, struct iovec * iov, int iovcnt)
+{
+	return do_rw_vec(READ,fd,iov,iovcnt);
+}
+
+int sys_writev(unsigned int fd, struct iovec * iov, int iovcnt)
+{
+	return do_rw_vec(WRITE,fd,iov,iovcnt);
+}
+
+/*
+ * pread() and pwrite() read and write at 'offset', leaving the file
+ * position alone. They take four arguments: the offset comes in %esi,
+ * see _sys_pread and _sys_pwrite in kernel/system_call.s.
+ */
+int do_pread(unsigned int fd, char * buf, int count, off_t offset)
+{
+	struct file * file;
+
+	if (fd>=NR_OPEN || count<0 || !(file=current->filp[fd]))
+		return -EINVAL;
+	if (file->f_inode->i_pipe)
+		return -ESPIPE;
+	if (offset < 0)
+		return -EINVAL;
+	if (!count)
+		return 0;
+	verify_area(buf,count);
+	return do_read(file,buf,count,&offset);
+}
+
+int do_pwrite(unsigned int fd, char * buf, int count, off_t offset)
+{
+	struct file * file;
+
+	if (fd>=NR_OPEN || count<0 || !(file=current->filp[fd]))
+		return -EINVAL;
+	if (file->f_inode->i_pipe)
+		return -ESPIPE;
+	if (offset < 0)
+		return -EINVAL;
+	if (!count)
+		return 0;
+	return do_write(file,buf,count,&offset);
+}
+
+/*
+ * sendfile() copies from a regular file to anything that can be written,
+ * straight out of the buffer cache: the blocks are handed to do_write()
+ * with fs pointing to kernel space, so pipes, ttys and files copy them
+ * with the same memcpy_fromfs() they use for user buffers. If 'offset' is
+ * not NULL, reading starts there and it is updated instead of the file
+ * position. Like pread(), the offset comes in %esi (see system_call.s).
+ */
+static char zero_block[BLOCK_SIZE];
+
+int do_sendfile(unsigned int out_fd, unsigned int in_fd, off_t * offset,
+	int count)
+{
+	struct file * in, * out;
+	struct m_inode * inode;
+	struct buffer_head * bh;
+	unsigned long old_fs;
+	off_t pos;
+	int nr, chars, res = 0, done = 0;
+
+	if (out_fd>=NR_OPEN || !(out=current->filp[out_fd]) || !(out->f_mode&2))
+		return -EBADF;
+	if (in_fd>=NR_OPEN || !(in=current->filp[in_fd]) || !(in->f_mode&1))
+		return -EBADF;
+	inode = in->f_inode;
+	// 只支持从普通文件读，这样才能直接用缓冲区里的块
+	if (inode->i_pipe || !S_ISREG(inode->i_mode) || count < 0)
+		return -EINVAL;
+	if (offset) {
+		verify_area(offset,sizeof(off_t));
+		if ((pos = (off_t) get_fs_long((unsigned long *) offset)) < 0)
+			return -EINVAL;
+	} else
+		pos = in->f_pos;
+	// 不能写成count+pos，count常是INT_MAX（全部发完），一加就溢出了
+	if (pos >= inode->i_size)
+		count = 0;
+	else if (count > inode->i_size - pos)
+		count = inode->i_size - pos;
+	old_fs = get_fs();
+	while (count > 0) {
+		if (nr = bmap(inode,pos/BLOCK_SIZE)) {
+			if (!(bh=bread(inode->i_dev,nr)))
+				break;
+		} else
+			bh = NULL;
+		nr = pos % BLOCK_SIZE;
+		chars = MIN(BLOCK_SIZE-nr,count);
+		// 让fs指向内核数据段，写的时候直接从缓冲块复制
+		set_fs(get_ds());
+		res = do_write(out,bh?bh->b_data+nr:zero_block,chars,&out->f_pos);
+		set_fs(old_fs);
+		brelse(bh);
+		if (res <= 0)
+			break;
+		pos += res;
+		done += res;
+		count -= res;
+		if (res < chars)
+			break;
+	}
+	inode->i_atime = CURRENT_TIME;
+	if (offset)
+		put_fs_long(pos,(unsigned long *) offset);
+	else
+		in->f_pos = pos;
+	return done?done:res;
 }
@@ -0,0 +1,103 @@
+/*
+ *  linux/fs/readdir.c
+ */
+
+/*
+ * getdents() returns the live entries of a directory, packed as struct
+ * dirent, so that ls and find don't have to read() the raw dir_entry
+ * blocks and skip the free ones. The blocks are read with breada(), so
+ * the next two blocks of a big directory are on their way while this
+ * one is copied out.
+ *
+ * f_pos is the offset of the next dir_entry, the same as for read(), so
+ * a call continues where the last one stopped, and lseek() to a d_off
+ * works too.
+ */
+#include <errno.h>
+#include <stddef.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/segment.h>
+
+// 名字后面加一个0，再按long对齐
+#define DIRENT_SIZE(len) \
+	((offsetof(struct dirent,d_name)+(len)+1+sizeof(long)-1) & \
+	~(sizeof(long)-1))
+
+// 读入目录的第block块，并预读后面两块，空洞返回NULL
+static struct buffer_head * dir_block(struct m_inode * inode, int block)
+{
+	int nr, next[2], i;
+
+	if (!(nr = bmap(inode,block)))
+		return NULL;
+	for (i = 0 ; i < 2 ; i++) {
+		next[i] = -1;
+		if ((block+1+i)*BLOCK_SIZE < inode->i_size &&
+		    (next[i] = bmap(inode,block+1+i)) == 0)
+			next[i] = -1;
+	}
+	return breada(inode->i_dev,nr,next[0],next[1],-1);
+}
+
+int sys_getdents(unsigned int fd, struct dirent * dirp, unsigned int count)
+{
+	struct file * file;
+	struct m_inode * inode;
+	struct buffer_head * bh = NULL;
+	struct dir_entry * de;
+	unsigned long pos, max;
+	int len, size, written = 0;
+
+	if (fd >= NR_OPEN || !(file = current->filp[fd]) ||
+	    !(inode = file->f_inode))
+		return -EBADF;
+	if (!S_ISDIR(inode->i_mode))
+		return -ENOTDIR;
+	// 用不到比整个目录都放下更多的空间，大的count在verify_area()里还会变成负数
+	max = inode->i_size/sizeof(struct dir_entry) * DIRENT_SIZE(NAME_LEN);
+	if (count > max)
+		count = max;
+	verify_area(dirp,count);
+	// 从lseek()来的位置可能不在项的边界上
+	pos = (file->f_pos + sizeof(struct dir_entry)-1) &
+		~(sizeof(struct dir_entry)-1);
+	while (pos < inode->i_size) {
+		if (!bh && !(bh = dir_block(inode,pos/BLOCK_SIZE))) {
+			pos = (pos/BLOCK_SIZE+1)*BLOCK_SIZE;
+			continue;
+		}
+		de = (struct dir_entry *) (bh->b_data + pos%BLOCK_SIZE);
+		// inode号为0的是空闲的项
+		if (de->inode) {
+			for (len = 0 ; len < NAME_LEN && de->name[len] ; len++)
+				/* nothing */ ;
+			size = DIRENT_SIZE(len);
+			if (written + size > count)
+				break;
+			put_fs_long(de->inode,(unsigned long *) &dirp->d_ino);
+			put_fs_long(pos+sizeof(struct dir_entry),
+				(unsigned long *) &dirp->d_off);
+			put_fs_word(size,(short *) &dirp->d_reclen);
+			memcpy_tofs(dirp->d_name,de->name,len);
+			put_fs_byte(0,dirp->d_name+len);
+			dirp = (struct dirent *) ((char *) dirp + size);
+			written += size;
+		}
+		pos += sizeof(struct dir_entry);
+		if (!(pos%BLOCK_SIZE)) {
+			brelse(bh);
+			bh = NULL;
+		}
+	}
+	brelse(bh);
+	// 一项都放不下
+	if (!written && pos < inode->i_size)
+		return -EINVAL;
+	file->f_pos = pos;
+	inode->i_atime = CURRENT_TIME;
+	return written;
+}
@@ -0,0 +1,288 @@
+/*
+ *  linux/fs/select.c
+ */
+
+/*
+ * 'select.c' implements select() and poll(), which wait for any of a set
+ * of file descriptors to become ready.
+ *
+ * Pipes and ttys have a list of the tasks selecting on them (i_select,
+ * and the 'select' of the secondary and write queues), on which the
+ * selecting task puts an entry of its select_table for each of them. The
+ * places that wake up readers and writers of a pipe or tty also wake
+ * up everything on these lists. Regular files, directories and the other
+ * devices never block, so they are always ready.
+ *
+ * The task is marked TASK_INTERRUPTIBLE before it looks at the objects,
+ * so a wakeup that comes in (even from an interrupt) after it has looked
+ * only makes the schedule() return at once. Timeouts use current->timeout,
+ * which schedule() checks like the alarm.
+ */
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include <sys/poll.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/tty.h>
+#include <linux/select.h>
+#include <asm/segment.h>
+#include <asm/system.h>
+
+void select_wait(struct select_wait ** list, select_table * p)
+{
+	struct select_wait * entry;
+	int i;
+
+	if (!p)
+		return;
+	for (i = 0 ; i < p->nr ; i++)
+		if (p->entry[i].wait_address == list)
+			return;
+	if (p->nr >= p->max)
+		panic("select_wait: select table full");
+	entry = p->entry + p->nr++;
+	entry->task = p->item ? NULL : current;
+	entry->item = p->item;
+	entry->wait_address = list;
+	// 中断里会遍历链表，所以关中断插入
+	cli();
+	entry->pprev = list;
+	if (entry->next = *list)
+		entry->next->pprev = &entry->next;
+	*list = entry;
+	sti();
+}
+
+// 可能在中断里调用，见rs_io.s
+void select_wake(struct select_wait ** list)
+{
+	struct select_wait * entry;
+
+	for (entry = *list ; entry ; entry = entry->next)
+		if (!entry->task)
+			epoll_wake(entry);
+		else if (entry->task->state == TASK_INTERRUPTIBLE)
+			entry->task->state = TASK_RUNNING;
+}
+
+void free_wait(select_table * p)
+{
+	struct select_wait * entry;
+	int i;
+
+	cli();
+	for (i = 0 ; i < p->nr ; i++) {
+		entry = p->entry + i;
+		if (*entry->pprev = entry->next)
+			entry->next->pprev = entry->pprev;
+	}
+	sti();
+	p->nr = 0;
+}
+
+static int pipe_poll(struct file * file, select_table * wait)
+{
+	struct m_inode * inode = file->f_inode;
+	int mask = 0;
+
+	select_wait(&inode->i_select,wait);
+	// i_count是读写两端的个数，不等于2说明另一端已经关闭
+	if (file->f_mode & 1) {
+		if (!PIPE_EMPTY(*inode))
+			mask |= POLLIN;
+		else if (inode->i_count != 2)
+			mask |= POLLHUP;
+	}
+	if (file->f_mode & 2) {
+		if (inode->i_count != 2)
+			mask |= POLLERR;
+		else if (!PIPE_FULL(*inode))
+			mask |= POLLOUT;
+	}
+	return mask;
+}
+
+/*
+ * Returns what the file is ready for. If 'wait' isn't NULL, we also go
+ * on the lists that will wake us when that changes.
+ */
+int poll_file(struct file * file, select_table * wait)
+{
+	struct m_inode * inode = file->f_inode;
+	int dev;
+
+	if (!inode)
+		return POLLNVAL;
+	if (inode->i_pipe)
+		return pipe_poll(file,wait);
+	if (inode->i_epoll)
+		return epoll_poll(inode,wait);
+	if (S_ISCHR(inode->i_mode)) {
+		dev = inode->i_zone[0];
+		// 4是ttyx，5是进程的控制终端tty，见char_dev.c
+		if (MAJOR(dev) == 4)
+			return tty_poll(MINOR(dev),wait);
+		if (MAJOR(dev) == 5)
+			return tty_poll(current->tty,wait);
+	}
+	return POLLIN | POLLOUT;
+}
+
+static int poll_fd(unsigned int fd, select_table * wait)
+{
+	if (fd >= NR_OPEN || !current->filp[fd])
+		return POLLNVAL;
+	return poll_file(current->filp[fd],wait);
+}
+
+// 在select()和poll()的栈上的表
+static void init_wait(select_table * p, struct select_wait * entry)
+{
+	p->nr = 0;
+	p->max = NR_SELECT;
+	p->entry = entry;
+	p->item = NULL;
+}
+
+// 超时时间转成jiffies，0表示不超时
+static long set_timeout(long ticks)
+{
+	return current->timeout = (ticks > 0) ? jiffies + ticks : 0;
+}
+
+static int signal_pending(void)
+{
+	return (current->signal & ~current->blocked) != 0;
+}
+
+/*
+ * The arguments are in a block in user space, as there are five of
+ * them: nfds, readfds, writefds, exceptfds and timeout. No exceptional
+ * conditions are ever reported.
+ */
+int sys_select(unsigned long * buffer)
+{
+	struct select_wait entry[NR_SELECT];
+	select_table wait;
+	fd_set in, out, res_in, res_out, * inp, * outp, * exp;
+	struct timeval * tvp;
+	long ticks = 0;
+	int n, fd, mask, count, expire;
+
+	n = get_fs_long(buffer);
+	inp = (fd_set *) get_fs_long(buffer+1);
+	outp = (fd_set *) get_fs_long(buffer+2);
+	exp = (fd_set *) get_fs_long(buffer+3);
+	tvp = (struct timeval *) get_fs_long(buffer+4);
+	if (n < 0)
+		return -EINVAL;
+	if (n > NR_OPEN)
+		n = NR_OPEN;
+	in = inp ? get_fs_long(inp) : 0;
+	out = outp ? get_fs_long(outp) : 0;
+	if (n < 32) {
+		in &= (1UL << n)-1;
+		out &= (1UL << n)-1;
+	}
+	for (fd = 0 ; fd < n ; fd++)
+		if (((in | out) >> fd) & 1)
+			if (poll_fd(fd,NULL) == POLLNVAL)
+				return -EBADF;
+	if (tvp) {
+		ticks = get_fs_long((unsigned long *) &tvp->tv_sec) * HZ +
+			(get_fs_long((unsigned long *) &tvp->tv_usec) +
+			1000000/HZ-1) / (1000000/HZ);
+		if (ticks < 0)
+			return -EINVAL;
+	}
+	init_wait(&wait,entry);
+	expire = set_timeout(ticks);
+	for (;;) {
+		current->state = TASK_INTERRUPTIBLE;
+		res_in = res_out = 0;
+		count = 0;
+		for (fd = 0 ; fd < n ; fd++) {
+			if (!(((in | out) >> fd) & 1))
+				continue;
+			mask = poll_fd(fd,&wait);
+			// 读端关闭了也算可读（读到文件尾），写端出错也算可写
+			if (((in >> fd) & 1) && (mask & (POLLIN | POLLHUP))) {
+				res_in |= 1UL << fd;
+				count++;
+			}
+			if (((out >> fd) & 1) && (mask & (POLLOUT | POLLERR))) {
+				res_out |= 1UL << fd;
+				count++;
+			}
+		}
+		if (count || (tvp && !ticks) || signal_pending() ||
+		    (expire && jiffies >= expire))
+			break;
+		schedule();
+	}
+	current->state = TASK_RUNNING;
+	current->timeout = 0;
+	free_wait(&wait);
+	if (!count && signal_pending())
+		return -EINTR;
+	if (inp) {
+		verify_area(inp,sizeof(fd_set));
+		put_fs_long(res_in,inp);
+	}
+	if (outp) {
+		verify_area(outp,sizeof(fd_set));
+		put_fs_long(res_out,outp);
+	}
+	if (exp) {
+		verify_area(exp,sizeof(fd_set));
+		put_fs_long(0,exp);
+	}
+	return count;
+}
+
+/*
+ * timeout is in milliseconds, a negative one means wait for ever.
+ */
+int sys_poll(struct pollfd * fds, unsigned int nfds, long timeout)
+{
+	struct select_wait entry[NR_SELECT];
+	select_table wait;
+	int i, count, fd, events, mask, expire;
+
+	if (nfds > NR_OPEN)
+		return -EINVAL;
+	if (nfds)
+		verify_area(fds,nfds*sizeof(struct pollfd));
+	init_wait(&wait,entry);
+	expire = set_timeout(timeout > 0 ? (timeout*HZ+999)/1000 : 0);
+	for (;;) {
+		current->state = TASK_INTERRUPTIBLE;
+		count = 0;
+		for (i = 0 ; i < nfds ; i++) {
+			fd = get_fs_long((unsigned long *) &fds[i].fd);
+			// 负数的fd被忽略
+			if (fd < 0)
+				mask = 0;
+			else {
+				events = get_fs_word((unsigned short *) &fds[i].events);
+				mask = poll_fd(fd,&wait) &
+					(events | POLLERR | POLLHUP | POLLNVAL);
+			}
+			put_fs_word(mask,&fds[i].revents);
+			if (mask)
+				count++;
+		}
+		if (count || !timeout || signal_pending() ||
+		    (expire && jiffies >= expire))
+			break;
+		schedule();
+	}
+	current->state = TASK_RUNNING;
+	current->timeout = 0;
+	free_wait(&wait);
+	if (!count && signal_pending())
+		return -EINTR;
+	return count;
+}
@@ -91,6 +91,8 @@ void put_super(int dev)
 		printk("Mounted disk changed - tssk, tssk\n\r");
 		return;
 	}
+	// 没提交的元数据只能丢掉了，卸载时已经提交过
+	journal_release(sb);
 	// 加锁
 	lock_super(sb);
 	sb->s_dev = 0; // 置为未使用状态
@@ -108,6 +110,7 @@ static struct super_block * read_super(int dev)
 {
 	struct super_block * s;
 	struct buffer_head * bh;
+	struct d_super_block * d;
 	int i,block;
 
 	if (!dev)
@@ -124,6 +127,7 @@ static struct super_block * read_super(int dev)
 			break;
 	}
 	s->s_dev = dev;
+	s->s_journal = NULL;
 	s->s_isup = NULL;
 	s->s_imount = NULL;
 	s->s_time = 0;
@@ -138,11 +142,28 @@ static struct super_block * read_super(int dev)
 		free_super(s);
 		return NULL;
 	}
-	*((struct d_super_block *) s) =
-		*((struct d_super_block *) bh->b_data);
+	d = (struct d_super_block *) bh->b_data;
+	s->s_ninodes = d->s_ninodes;
+	s->s_nzones = d->s_nzones;
+	s->s_imap_blocks = d->s_imap_blocks;
+	s->s_zmap_blocks = d->s_zmap_blocks;
+	s->s_firstdatazone = d->s_firstdatazone;
+	s->s_log_zone_size = d->s_log_zone_size;
+	s->s_max_size = d->s_max_size;
+	s->s_magic = d->s_magic;
+	// v2的块数是32位的，在s_zones中
+	if (s->s_magic == SUPER_MAGIC_V2)
+		s->s_nzones = d->s_zones;
 	brelse(bh);
 	// 不是超级块则rollback
-	if (s->s_magic != SUPER_MAGIC) {
+	if (s->s_magic != SUPER_MAGIC && s->s_magic != SUPER_MAGIC_V2) {
+		s->s_dev = 0;
+		free_super(s);
+		return NULL;
+	}
+	// 位图块太多，放不下
+	if (s->s_imap_blocks > I_MAP_SLOTS || s->s_zmap_blocks > Z_MAP_SLOTS) {
+		printk("read_super: too many bitmap blocks\n\r");
 		s->s_dev = 0;
 		free_super(s);
 		return NULL;
@@ -156,7 +177,7 @@ static struct super_block * read_super(int dev)
 	block=2;
 	// 读inode和块位图信息,s_imap_blocks块表示inode位图
 	for (i=0 ; i < s->s_imap_blocks ; i++)
-		if (s->s_imap[i]=bread(dev,block)) // s_imap_blocks > 8时会溢出
+		if (s->s_imap[i]=bread(dev,block))
 			block++;
 		else
 			break;
@@ -178,7 +199,11 @@ static struct super_block * read_super(int dev)
 	// 第一个不能使用,置第一个为已使用,因为找空闲块的时候，返回0表示失败。所以第0块可用的话会有二义性
 	s->s_imap[0]->b_data[0] |= 1;
 	s->s_zmap[0]->b_data[0] |= 1;
+	// 统计每个位图块中的空闲位数
+	count_free(s);
 	free_super(s);
+	// 有日志文件的话，先把上次没写完的元数据重放
+	journal_load(s);
 	return s;
 }
 
@@ -208,8 +233,9 @@ int sys_umount(char * dev_name)
 	if (!sb->s_imount->i_mount)
 		printk("Mounted inode has i_mount=0\n");
 	/// 判断是否有进程在使用该inode，有的话不能卸载
-	for (inode=inode_table+0 ; inode<inode_table+NR_INODE ; inode++)
-		if (inode->i_dev==dev && inode->i_count)
+	for (inode=inode_table+0 ; inode<inode_table+nr_inodes ; inode++)
+		if (inode->i_dev==dev && inode->i_count &&
+		    !journal_inode(inode))
 				return -EBUSY;
 	// 清除inode的挂载标记
 	sb->s_imount->i_mount=0;
@@ -217,6 +243,9 @@ int sys_umount(char * dev_name)
 	sb->s_imount = NULL;
 	iput(sb->s_isup);
 	sb->s_isup = NULL;
+	// 日志还在的时候提交，put_super()会释放日志。这里什么都没锁着，可以等句柄
+	journal_commit(dev);
+	sync_dev(dev);
 	put_super(dev);
 	sync_dev(dev);
 	return 0;
@@ -280,7 +309,7 @@ void mount_root(void)
 	struct super_block * p;
 	struct m_inode * mi;
 
-	if (32 != sizeof (struct d_inode))
+	if (32 != sizeof (struct d_inode) || 64 != sizeof (struct d2_inode))
 		panic("bad i-node size");
 	// 初始化file结构体列表，struct file file_table[NR_FILE];
 	for(i=0;i<NR_FILE;i++)
@@ -293,6 +322,7 @@ void mount_root(void)
 	// 初始化超级块列表
 	for(p = &super_block[0] ; p < &super_block[NR_SUPER] ; p++) {
 		p->s_dev = 0;
+		p->s_journal = NULL;
 		p->s_lock = 0;
 		p->s_wait = NULL;
 	}
@@ -309,17 +339,13 @@ void mount_root(void)
 	// 设置当前进程（进程1）的根文件目录和当前工作目录
 	current->pwd = mi;
 	current->root = mi;
+	// read_super()已经数好了每个位图块中的空闲位数
 	free=0;
-	// 文件系统的逻辑数据块和inode数量
-	i=p->s_nzones;
-	while (-- i >= 0)
-		if (!set_bit(i&8191,p->s_zmap[i>>13]->b_data))
-			free++;
+	for (i=0;i<Z_MAP_SLOTS;i++)
+		free += p->s_zfree[i];
 	printk("%d/%d free blocks\n\r",free,p->s_nzones);
 	free=0;
-	i=p->s_ninodes+1;
-	while (-- i >= 0)
-		if (!set_bit(i&8191,p->s_imap[i>>13]->b_data))
-			free++;
+	for (i=0;i<I_MAP_SLOTS;i++)
+		free += p->s_ifree[i];
 	printk("%d/%d free inodes\n\r",free,p->s_ninodes);
 }
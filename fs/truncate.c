@@ -8,66 +8,93 @@
 
 #include <sys/stat.h>
 
-// 释放一级数据块
-static void free_ind(int dev,int block)
+/*
+ * The blocks of a file are mostly contiguous, so truncate() collects
+ * them into runs and frees each run with one free_blocks() call instead
+ * of one free_block() per block.
+ */
+struct zone_run {
+	int dev;
+	int start;
+	int len;
+};
+
+static void flush_run(struct zone_run * run)
 {
-	struct buffer_head * bh;
-	unsigned short * p;
-	int i;
+	if (run->len)
+		free_blocks(run->dev,run->start,run->len);
+	run->len = 0;
+}
 
-	if (!block)
+// 和当前一段相连就接上去（间接块在它的数据块之后释放，所以前面也可以接），否则先释放当前一段
+static void free_zone(struct zone_run * run, int zone)
+{
+	if (run->len && zone == run->start+run->len) {
+		run->len++;
+		return;
+	}
+	if (run->len && zone == run->start-1) {
+		run->start--;
+		run->len++;
 		return;
-	// 读入第block块数据，里面保存了文件内容对应的512个块号
-	if (bh=bread(dev,block)) {
-		p = (unsigned short *) bh->b_data;
-		for (i=0;i<512;i++,p++)
-			if (*p)
-				free_block(dev,*p);
-		brelse(bh);
 	}
-	// 最后把一级数据块也释放掉
-	free_block(dev,block);
+	flush_run(run);
+	run->start = zone;
+	run->len = 1;
 }
 
-// 释放二级数据块
-static void free_dind(int dev,int block)
+/*
+	释放间接块block和它下面的所有块，depth为1时间接块里保存的是数据块号，
+	为2、3时保存的是下一级间接块的块号
+*/
+static void free_ind(struct m_inode * inode,int block,int depth,
+	struct zone_run * run)
 {
 	struct buffer_head * bh;
-	unsigned short * p;
-	int i;
+	int i,zone;
 
 	if (!block)
 		return;
-	if (bh=bread(dev,block)) {
-		p = (unsigned short *) bh->b_data;
-		for (i=0;i<512;i++,p++)
-			if (*p)
-				free_ind(dev,*p);
+	// 读入第block块数据，里面保存了ZONES_PER_BLOCK个块号
+	if (bh=bread(inode->i_dev,block)) {
+		for (i=0;i<ZONES_PER_BLOCK(inode);i++)
+			if (zone = IND_ZONE(inode,bh,i)) {
+				if (depth > 1)
+					free_ind(inode,zone,depth-1,run);
+				else
+					free_zone(run,zone);
+			}
 		brelse(bh);
 	}
-	free_block(dev,block);
+	// 最后把间接块也释放掉，它的buffer已经brelse()了
+	free_zone(run,block);
 }
 // 清空文件
 void truncate(struct m_inode * inode)
 {
+	struct zone_run run;
 	int i;
 	// 是目录或一般文件
 	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
 		return;
+	// 目录的散列索引也没用了
+	dindex_free(inode);
+	run.dev = inode->i_dev;
+	run.len = 0;
 	// 释放全部的直接数据块
 	for (i=0;i<7;i++)
 		if (inode->i_zone[i]) {
-			free_block(inode->i_dev,inode->i_zone[i]);
+			free_zone(&run,inode->i_zone[i]);
 			inode->i_zone[i]=0;
 		}
-	// 释放一级数据块
-	free_ind(inode->i_dev,inode->i_zone[7]);
-	// 释放二级数据块
-	free_dind(inode->i_dev,inode->i_zone[8]);
-	inode->i_zone[7] = inode->i_zone[8] = 0;
+	// 释放一级、二级和三级（只有v2有）间接块
+	for (i=7;i<10;i++) {
+		free_ind(inode,inode->i_zone[i],i-6,&run);
+		inode->i_zone[i] = 0;
+	}
+	flush_run(&run);
 	// 文件大小为0
 	inode->i_size = 0;
 	inode->i_dirt = 1;
 	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
 }
-
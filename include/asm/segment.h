@@ -37,6 +37,94 @@ extern inline void put_fs_long(unsigned long val,unsigned long * addr)
 __asm__ ("movl %0,%%fs:%1"::"r" (val),"m" (*addr));
 }
 
+/*
+ * The bulk versions move a block at a time with "rep movsl", the odd
+ * byte and word first. Reads go through a %fs prefix, writes through
+ * %es, which is loaded from %fs (movs always stores to %es:%edi).
+ *
+ * Nothing here checks the user addresses. A 386 doesn't honour the
+ * write-protect bit in kernel mode, so the caller must verify_area()
+ * a buffer before writing to it, as sys_read() and friends already do.
+ */
+extern inline void memcpy_fromfs(void * to, const void * from,
+	unsigned long n)
+{
+	long d0, d1, d2;
+
+__asm__ __volatile__("cld\n\t"
+	"testb $1,%%cl\n\t"
+	"je 1f\n\t"
+	"fs ; movsb\n"
+	"1:\ttestb $2,%%cl\n\t"
+	"je 2f\n\t"
+	"fs ; movsw\n"
+	"2:\tshrl $2,%%ecx\n\t"
+	"rep ; fs ; movsl"
+	:"=&c" (d0),"=&D" (d1),"=&S" (d2)
+	:"0" (n),"1" ((long) to),"2" ((long) from)
+	:"memory");
+}
+
+extern inline void memcpy_tofs(void * to, const void * from,
+	unsigned long n)
+{
+	long d0, d1, d2;
+
+__asm__ __volatile__("cld\n\t"
+	"push %%es\n\t"
+	"push %%fs\n\t"
+	"pop %%es\n\t"
+	"testb $1,%%cl\n\t"
+	"je 1f\n\t"
+	"movsb\n"
+	"1:\ttestb $2,%%cl\n\t"
+	"je 2f\n\t"
+	"movsw\n"
+	"2:\tshrl $2,%%ecx\n\t"
+	"rep ; movsl\n\t"
+	"pop %%es"
+	:"=&c" (d0),"=&D" (d1),"=&S" (d2)
+	:"0" (n),"1" ((long) to),"2" ((long) from)
+	:"memory");
+}
+
+// 把n个字节的用户空间清0
+extern inline void memset_tofs(void * to, unsigned long n)
+{
+	long d0, d1;
+
+__asm__ __volatile__("cld\n\t"
+	"push %%es\n\t"
+	"push %%fs\n\t"
+	"pop %%es\n\t"
+	"rep ; stosb\n\t"
+	"pop %%es"
+	:"=&c" (d0),"=&D" (d1)
+	:"a" (0),"0" (n),"1" ((long) to)
+	:"memory");
+}
+
+// 用户空间字符串的长度（不包括结尾的0），最多数到max
+extern inline int strnlen_fs(const char * s, int max)
+{
+	int __res;
+	long d0, d1;
+
+__asm__ __volatile__("cld\n\t"
+	"movl %%ecx,%%edx\n\t"
+	"jecxz 2f\n"
+	"1:\tfs ; lodsb\n\t"
+	"testb %%al,%%al\n\t"
+	"je 2f\n\t"
+	"decl %%ecx\n\t"
+	"jne 1b\n"
+	"2:\tsubl %%ecx,%%edx"
+	:"=&d" (__res),"=&c" (d0),"=&S" (d1)
+	:"1" (max),"2" (s)
+	:"ax");
+return __res;
+}
+
 /*
  * Someone who knows GNU asm better than I should double check the followig.
  * It seems to work, but I don't know if I'm doing something subtly wrong.
@@ -26,6 +26,13 @@ __asm__ ("movl %%esp,%%eax\n\t" \
 
 #define iret() __asm__ ("iret"::)
 
+// 保存和恢复eflags，用来在关中断之后恢复到原来的中断状态，而不是直接开中断
+#define save_flags(x) \
+__asm__("pushfl ; popl %0":"=r" (x))
+
+#define restore_flags(x) \
+__asm__("pushl %0 ; popfl"::"r" (x))
+
 #define _set_gate(gate_addr,type,dpl,addr) \
 // 把dx即处理函数地址的低16位赋值给ax，不影响eax的高16位
 __asm__ ("movw %%dx,%%ax\n\t" \
@@ -0,0 +1,22 @@
+#ifndef _DIRENT_H
+#define _DIRENT_H
+
+#include <sys/types.h>
+
+#define MAXNAMLEN 14	/* NAME_LEN of the minix fs */
+
+/*
+ * What getdents() returns: entries of d_reclen bytes one after the
+ * other, d_reclen keeps the next one aligned to a long. d_off is where
+ * the directory has to be lseek()'ed to continue after this entry.
+ */
+struct dirent {
+	long d_ino;
+	off_t d_off;
+	unsigned short d_reclen;
+	char d_name[MAXNAMLEN+1];
+};
+
+extern int getdents(int fd, struct dirent * dirp, unsigned int count);
+
+#endif
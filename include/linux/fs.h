@@ -37,15 +37,18 @@ void buffer_init(long buffer_end);
 #define NAME_LEN 14
 // 文件系统的根inode节点号
 #define ROOT_INO 1
-// 块位图和inode位图占据的最大硬盘块数
+// 块位图和inode位图占据的最大硬盘块数，v2文件系统可以有更多的块
 #define I_MAP_SLOTS 8
-#define Z_MAP_SLOTS 8
-// 超级块的魔数，说明是有效的超级块
+#define Z_MAP_SLOTS 64
+// 超级块的魔数，说明是有效的超级块，v2是32位块号的minix文件系统
 #define SUPER_MAGIC 0x137F
+#define SUPER_MAGIC_V2 0x2468
 // 一个进程打开文件数的大小
 #define NR_OPEN 20
-// 系统同时打开的inode数大小，即同时只能打开32个文件
-#define NR_INODE 32
+// 内存中inode表的大小，启动时根据内存大小在这两个值之间选
+#define NR_INODE_MIN 32
+#define NR_INODE_MAX 2048
+#define NR_IHASH 307
 // file结构体数，进程间共享的
 #define NR_FILE 64
 // 超级块数，即文件系统的个数
@@ -62,17 +65,46 @@ void buffer_init(long buffer_end);
 #endif
 // 每个硬盘块有几个inode节点，即块大小除以硬盘中每个inode结构的大小，硬盘里是d_inode，内存是m_inode结构
 #define INODES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct d_inode)))
+#define V2_INODES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct d2_inode)))
 // 每个硬盘块包含的目录项数
 #define DIR_ENTRIES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct dir_entry)))
 
 // 下面宏用于匿名管道，可结合管道的实现理解
+/*
+ * A pipe is a ring of PIPE_PAGES pages: the first one is in i_size, the
+ * others in i_zone[3] and up. Head and tail are byte offsets in the ring.
+ */
+#define PIPE_MAX_PAGES 8
 #define PIPE_HEAD(inode) ((inode).i_zone[0])
 #define PIPE_TAIL(inode) ((inode).i_zone[1])
-#define PIPE_SIZE(inode) ((PIPE_HEAD(inode)-PIPE_TAIL(inode))&(PAGE_SIZE-1))
+#define PIPE_PAGES(inode) ((inode).i_zone[2])
+#define PIPE_PAGE(inode,nr) ((nr)?(inode).i_zone[2+(nr)]:(inode).i_size)
+#define PIPE_BUF_SIZE(inode) (PIPE_PAGES(inode)*PAGE_SIZE)
+#define PIPE_SIZE(inode) ((PIPE_HEAD(inode)-PIPE_TAIL(inode)+PIPE_BUF_SIZE(inode)) \
+	% PIPE_BUF_SIZE(inode))
 #define PIPE_EMPTY(inode) (PIPE_HEAD(inode)==PIPE_TAIL(inode))
-#define PIPE_FULL(inode) (PIPE_SIZE(inode)==(PAGE_SIZE-1))
-#define INC_PIPE(head) \
-__asm__("incl %0\n\tandl $4095,%0"::"m" (head))
+#define PIPE_FULL(inode) (PIPE_SIZE(inode)==PIPE_BUF_SIZE(inode)-1)
+// 正在复制数据的读写进程数，这时不能换页，管道用不到目录的i_dversion
+#define PIPE_BUSY(inode) ((inode).i_dversion)
+
+// v1的i_nlinks在硬盘上只有8位
+#define MAX_LINKS(inode) ((inode)->i_v2 ? 65530 : 250)
+
+/*
+ * Indirect blocks hold 16-bit zone numbers on a v1 filesystem and 32-bit
+ * ones on a v2 filesystem. These read and write entry 'i' of the indirect
+ * block in 'bh', which belongs to 'inode'.
+ */
+#define ZONES_PER_BLOCK(inode) ((inode)->i_v2 ? BLOCK_SIZE/4 : BLOCK_SIZE/2)
+#define IND_ZONE(inode,bh,i) ((inode)->i_v2 ? \
+	((unsigned long *) (bh)->b_data)[i] : \
+	((unsigned short *) (bh)->b_data)[i])
+#define SET_IND_ZONE(inode,bh,i,zone) do { \
+	if ((inode)->i_v2) \
+		((unsigned long *) (bh)->b_data)[i] = (zone); \
+	else \
+		((unsigned short *) (bh)->b_data)[i] = (zone); \
+} while (0)
 // 该版本没有用这个定义
 typedef char buffer_block[BLOCK_SIZE];
 // 管理文件系统的数据缓存的结构
@@ -84,12 +116,25 @@ struct buffer_head {
 	unsigned char b_dirt;		/* 0-clean,1-dirty */
 	unsigned char b_count;		/* users using this block */
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */
+	unsigned char b_journal;	/* metadata: written through the journal */
 	struct task_struct * b_wait;
 	struct buffer_head * b_prev;
 	struct buffer_head * b_next;
 	struct buffer_head * b_prev_free;
 	struct buffer_head * b_next_free;
 };
+// 位图、inode块、间接块和目录块是元数据，挂了日志的设备上要先写日志再写回原处
+#define journal_dirty(bh) ((bh)->b_journal = (bh)->b_dirt = 1)
+/*
+ * Credits of a journal handle: the most metadata blocks the operation can
+ * dirty, see journal_start(). J_ZMAP adds all the block bitmaps of the
+ * device, as freeing a file (or allocating a run) can touch any of them.
+ */
+#define J_ZMAP		0x1000
+#define J_INODE		1		/* chmod(), utime() ... */
+#define J_DIROP		(10|J_ZMAP)	/* mkdir(), unlink(), iput() ... */
+#define J_WRITE		(8|J_ZMAP)	/* up to 256 blocks in a row */
+#define J_WRITE_BLOCKS	64		/* a run of file_write() */
 // 文件系统在硬盘里的inode节点结构
 struct d_inode {
 	// 各种标记位，读写执行等，我们ls时看到的
@@ -106,20 +151,42 @@ struct d_inode {
 	// 存储文件内容对应的硬盘块号
 	unsigned short i_zone[9];
 };
+// v2文件系统在硬盘里的inode节点结构，块号是32位的，多了一个三级间接块
+struct d2_inode {
+	unsigned short i_mode;
+	unsigned short i_nlinks;
+	unsigned short i_uid;
+	unsigned short i_gid;
+	unsigned long i_size;
+	unsigned long i_atime;
+	unsigned long i_mtime;
+	unsigned long i_ctime;
+	unsigned long i_zone[10];
+};
 // 内存中的inode节点结构
+struct dir_index;
+struct select_wait;
+struct eventpoll;
+
 struct m_inode {
-	// 和d_inode一样
+	// 和d_inode差不多，读写时和d_inode或d2_inode互相转换
 	unsigned short i_mode;
 	unsigned short i_uid;
 	unsigned long i_size;
 	unsigned long i_mtime;
-	unsigned char i_gid;
-	unsigned char i_nlinks;
-	unsigned short i_zone[9];
+	// v2在硬盘上是16位的，v1是8位的
+	unsigned short i_gid;
+	unsigned short i_nlinks;
+	// v1只用前9项，i_zone[9]是v2的三级间接块
+	unsigned long i_zone[10];
 /* these are in memory also */
 	// 在内存中使用的字段
 	// 等待该inode节点的进程队列
 	struct task_struct * i_wait;
+	// 在select()或poll()中等待该管道的进程，见fs/select.c
+	struct select_wait * i_select;
+	// epoll_create()的inode，指向fs/eventpoll.c的eventpoll
+	struct eventpoll * i_epoll;
 	// access time文件被访问就会修改这个字段
 	unsigned long i_atime;
 	/*
@@ -151,6 +218,16 @@ struct m_inode {
 		缓存里直接读取。
 	*/
 	unsigned char i_update;
+	// 是不是v2文件系统的inode
+	unsigned char i_v2;
+	// 大目录在内存中的散列索引，见fs/dindex.c
+	struct dir_index * i_dindex;
+	// 目录每被修改一次就加一
+	unsigned short i_dversion;
+	// (dev,nr)哈希链
+	struct m_inode * i_hash_next, ** i_hash_pprev;
+	// 没有被引用的inode在lru链表上，链表头最先被重用
+	struct m_inode * i_free_next, * i_free_prev;
 };
 // 管理打开文件的内存属性的结构，比如操作位置(inode没有读取操作位置这个概念，),实现系统进程共享inode
 struct file {
@@ -164,8 +241,8 @@ struct file {
 struct super_block {
 	// inode节点个数
 	unsigned short s_ninodes;
-	// 数据块占据的逻辑块总块数
-	unsigned short s_nzones;
+	// 数据块占据的逻辑块总块数，v2文件系统是硬盘中的s_zones
+	unsigned long s_nzones;
 	// inode和数据块位图占据的硬盘块数，位图是记录哪个块或者inode节点被使用了
 	unsigned short s_imap_blocks;
 	unsigned short s_zmap_blocks;
@@ -187,9 +264,9 @@ struct super_block {
 	unsigned short s_magic;
 /* These are only in memory */
 	// 缓存inode位图的内容
-	struct buffer_head * s_imap[8];
+	struct buffer_head * s_imap[I_MAP_SLOTS];
 	// 缓存数据块位图的内容
-	struct  buffer_head * s_zmap[8];
+	struct  buffer_head * s_zmap[Z_MAP_SLOTS];
 	// 设备号
 	unsigned short s_dev;
 	// 挂载在哪个文件的inode下
@@ -204,6 +281,14 @@ struct super_block {
 	unsigned char s_rd_only;
 	// 是否需要回写到硬盘
 	unsigned char s_dirt;
+	// 每个位图块中空闲位的个数，为0的位图块分配时直接跳过
+	unsigned short s_ifree[I_MAP_SLOTS];
+	unsigned short s_zfree[Z_MAP_SLOTS];
+	// 最近一次分配的inode和数据块在位图中的位置，没有目标时从它后面开始找
+	unsigned short s_ilast;
+	unsigned long s_zlast;
+	// 元数据日志，没有日志文件则为NULL，见journal.c
+	struct journal * s_journal;
 };
 // 超级块在硬盘的结构
 struct d_super_block {
@@ -223,6 +308,10 @@ struct d_super_block {
 	unsigned long s_max_size;
 	// 判断是否是超级块的标记
 	unsigned short s_magic;
+	// 下面两个只有v2有
+	unsigned short s_state;
+	// 32位的数据块总数
+	unsigned long s_zones;
 };
 // 目录项结构
 struct dir_entry {
@@ -232,7 +321,8 @@ struct dir_entry {
 	char name[NAME_LEN];
 };
 // 进程共享的inode列表
-extern struct m_inode inode_table[NR_INODE];
+extern struct m_inode * inode_table;
+extern int nr_inodes;
 // 进程共享的file结构列表
 extern struct file file_table[NR_FILE];
 // 超级块列表
@@ -249,31 +339,70 @@ extern void floppy_on(unsigned int dev);
 extern void floppy_off(unsigned int dev);
 extern void truncate(struct m_inode * inode);
 extern void sync_inodes(void);
+extern int sync_inode(struct m_inode * inode);
+extern void invalidate_inodes(int dev);
 extern void wait_on(struct m_inode * inode);
 extern int bmap(struct m_inode * inode,int block);
 extern int create_block(struct m_inode * inode,int block);
+extern int create_blocks(struct m_inode * inode, int block, int * count);
+extern void aio_exit(void);
 extern struct m_inode * namei(const char * pathname);
 extern int open_namei(const char * pathname, int flag, int mode,
 	struct m_inode ** res_inode);
 extern void iput(struct m_inode * inode);
 extern struct m_inode * iget(int dev,int nr);
 extern struct m_inode * get_empty_inode(void);
+extern void insert_inode_hash(struct m_inode * inode);
+extern long inode_init(long mem_start, long mem_end);
 extern struct m_inode * get_pipe_inode(void);
+extern void free_pipe_pages(struct m_inode * inode);
+extern int pipe_resize(struct m_inode * inode, unsigned long size);
 extern struct buffer_head * get_hash_table(int dev, int block);
 extern struct buffer_head * getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head * bh);
 extern void brelse(struct buffer_head * buf);
+extern void sort_buffers(struct buffer_head ** list, int n);
 extern struct buffer_head * bread(int dev,int block);
 extern void bread_page(unsigned long addr,int dev,int b[4]);
 extern struct buffer_head * breada(int dev,int block,...);
-extern int new_block(int dev);
+extern int new_blocks(int dev, int goal, int * count);
+extern int new_block(int dev, int goal);
+extern void free_blocks(int dev, int block, int count);
 extern void free_block(int dev, int block);
-extern struct m_inode * new_inode(int dev);
+extern void count_free(struct super_block * sb);
+extern struct m_inode * new_inode(int dev, int goal);
 extern void free_inode(struct m_inode * inode);
 extern int sync_dev(int dev);
 extern struct super_block * get_super(int dev);
 extern int ROOT_DEV;
 
 extern void mount_root(void);
+extern int dcache_lookup(struct m_inode * dir, const char * name, int len,
+	int * ino);
+extern void dcache_add(struct m_inode * dir, const char * name, int len,
+	int ino, unsigned short version);
+extern void dcache_invalidate(struct m_inode * dir, const char * name,
+	int len);
+extern void dcache_invalidate_dir(int dev, int dir);
+extern void dcache_invalidate_dev(int dev);
+extern void dcache_init(void);
+extern int dindex_build(struct m_inode * dir);
+extern void dindex_free(struct m_inode * dir);
+extern int dindex_shrink(void);
+extern unsigned long dindex_hash(const char * name, int len);
+extern long dindex_next(struct m_inode * dir, unsigned long hash, long slot);
+extern long dindex_alloc(struct m_inode * dir);
+extern void dindex_release(struct m_inode * dir, long slot);
+extern void dindex_add(struct m_inode * dir, long slot, unsigned long hash);
+extern void dindex_remove(struct m_inode * dir, struct buffer_head * bh,
+	struct dir_entry * de);
+extern void journal_load(struct super_block * sb);
+extern void journal_release(struct super_block * sb);
+extern int journal_active(int dev);
+extern int journal_commit(int dev);
+extern int journal_try_commit(int dev);
+extern void journal_start(int credits);
+extern void journal_stop(void);
+extern int journal_inode(struct m_inode * inode);
 
 #endif
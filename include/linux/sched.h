@@ -1,11 +1,23 @@
 #ifndef _SCHED_H
 #define _SCHED_H
 
-#define NR_TASKS 64
+/*
+ * NR_TASKS is only the size of the task-table now: tasks no longer use
+ * gdt-entries of their own, and every task has its own page-directory,
+ * so the real limit is the amount of free memory.
+ */
+#define NR_TASKS 4096
 #define HZ 100
+// 除了进程0，每个进程的线性地址都从USER_BASE开始，长度为TASK_SIZE，靠各自的页目录区分
+#define USER_BASE 0x4000000
+#define TASK_SIZE 0x4000000
+// pid的范围是1到PID_MAX-1，pid位图的大小由它决定
+#define PID_MAX 32768
+#define PIDHASH_SZ 64
+#define pid_hashfn(x) ((((x) >> 6) ^ (x)) & (PIDHASH_SZ - 1))
 
 #define FIRST_TASK task[0]
-#define LAST_TASK task[NR_TASKS-1]
+#define LAST_TASK task[nr_tasks-1]
 
 #include <linux/head.h>
 #include <linux/fs.h>
@@ -26,10 +38,16 @@
 #define NULL ((void *) 0)
 #endif
 
-extern int copy_page_tables(unsigned long from, unsigned long to, long size);
+struct task_struct;
+
+extern int copy_page_tables(unsigned long from, unsigned long to, long size,
+	struct task_struct * p);
 extern int free_page_tables(unsigned long from, unsigned long size);
+extern unsigned long new_page_dir(void);
+extern void free_page_dir(struct task_struct * p);
 
 extern void sched_init(void);
+extern void sysenter_init(void);
 extern void schedule(void);
 extern void trap_init(void);
 extern void panic(const char * str);
@@ -104,6 +122,21 @@ struct task_struct {
 	struct desc_struct ldt[3];
 /* tss for this task */
 	struct tss_struct tss;
+/* process tree: parent, youngest child, younger sibling, older sibling */
+	struct task_struct *p_pptr, *p_cptr, *p_ysptr, *p_osptr;
+/* pid, process group and session hash chains, see kernel/pid.c */
+	struct task_struct *pidhash_next, **pidhash_pprev;
+	struct task_struct *pgrp_next, **pgrp_pprev;
+	struct task_struct *session_next, **session_pprev;
+/* accounting, see sys_pstat() */
+	long nvcsw,nivcsw;		/* voluntary/involuntary switches */
+	long min_flt,maj_flt;		/* page faults without/with disk io */
+	long inblock,oublock;		/* blocks read/written */
+	long wtime;			/* ticks spent in sleep_on() */
+	long timeout;			/* wake up at this jiffy, see select() */
+/* journal handle, see fs/journal.c */
+	short journal;			/* nesting depth, 0 if none */
+	short credits;			/* of the outermost one */
 };
 
 /*
@@ -134,6 +167,8 @@ struct task_struct {
 }
 
 extern struct task_struct *task[NR_TASKS];
+// task[]中最大的已用下标加一，遍历进程的循环只需要走到这里
+extern int nr_tasks;
 extern struct task_struct *last_task_used_math;
 extern struct task_struct *current;
 extern long volatile jiffies;
@@ -141,57 +176,121 @@ extern long startup_time;
 
 #define CURRENT_TIME (startup_time+jiffies/HZ)
 
+extern struct task_struct * pidhash[PIDHASH_SZ];
+extern struct task_struct * pgrphash[PIDHASH_SZ];
+extern struct task_struct * sesshash[PIDHASH_SZ];
+// 哈希链的第一个节点，遍历时还需要比较pgrp或session，因为不同的id可能落在同一条链
+#define pgrp_hash(pgrp) (pgrphash[pid_hashfn(pgrp)])
+#define session_hash(session) (sesshash[pid_hashfn(session)])
+
+extern void hash_pid(struct task_struct * p);
+extern void unhash_pid(struct task_struct * p);
+extern void attach_pgrp(struct task_struct * p);
+extern void detach_pgrp(struct task_struct * p);
+extern void attach_session(struct task_struct * p);
+extern void detach_session(struct task_struct * p);
+extern struct task_struct * find_task_by_pid(int pid);
+extern int alloc_pid(void);
+extern void free_pid(int pid);
+extern void pid_init(void);
+extern void task_slot_init(void);
+extern void free_task_slot(int nr);
+
+/*
+ * The children of a task are kept on a list headed by p_cptr (the
+ * youngest child) and linked through p_osptr/p_ysptr.
+ */
+#define REMOVE_LINKS(p) do { \
+	if ((p)->p_osptr) \
+		(p)->p_osptr->p_ysptr = (p)->p_ysptr; \
+	if ((p)->p_ysptr) \
+		(p)->p_ysptr->p_osptr = (p)->p_osptr; \
+	else \
+		(p)->p_pptr->p_cptr = (p)->p_osptr; \
+	} while (0)
+
+#define SET_LINKS(p) do { \
+	(p)->p_ysptr = NULL; \
+	if (((p)->p_osptr = (p)->p_pptr->p_cptr) != NULL) \
+		(p)->p_osptr->p_ysptr = (p); \
+	(p)->p_pptr->p_cptr = (p); \
+	} while (0)
+
 extern void add_timer(long jiffies, void (*fn)(void));
 extern void sleep_on(struct task_struct ** p);
 extern void interruptible_sleep_on(struct task_struct ** p);
 extern void wake_up(struct task_struct ** p);
 
 /*
- * Entry into gdt where to find first TSS. 0-nul, 1-cs, 2-ds, 3-syscall
- * 4-TSS0, 5-LDT0, 6-TSS1 etc ...
+ * Entry into gdt where to find the TSS. 0-nul, 1-cs, 2-ds, 3-syscall
+ * 4-TSS, 5-LDT.
+ *
+ * There is only one TSS, and the cpu only uses it to find the kernel
+ * stack (esp0) when coming in from user mode. Tasks are switched in
+ * software by switch_to(), which also rewrites the LDT entry.
  */
 #define FIRST_TSS_ENTRY 4
 #define FIRST_LDT_ENTRY (FIRST_TSS_ENTRY+1)
-// 第一个tss选择子的偏移是4<<3，4乘以8，等于32，即从GDT的偏移为32开始算，第一个进程的n是0，tss是32
 #define _TSS(n) ((((unsigned long) n)<<4)+(FIRST_TSS_ENTRY<<3))
-// 第一个ldt选择子的偏移是5<<3，5乘以8，等于40，即从GDT的偏移为40开始算，第一个进程的n是0，ldt是40
 #define _LDT(n) ((((unsigned long) n)<<4)+(FIRST_LDT_ENTRY<<3))
 /*
-	加载第n个进程的tss选择子到ltr，根据选择子从GDT拿到tss的段选择符，
-	然后找到tss的内容，再把某些内容加载到相应寄存器
+	加载tss选择子到tr，根据选择子从GDT拿到tss的段选择符，
+	之后从用户态进入内核时cpu会从这个tss中取得内核栈
 */
 #define ltr(n) __asm__("ltr %%ax"::"a" (_TSS(n)))
 #define lldt(n) __asm__("lldt %%ax"::"a" (_LDT(n)))
-#define str(n) \
-__asm__("str %%ax\n\t" \
-	"subl %2,%%eax\n\t" \
-	"shrl $4,%%eax" \
-	:"=a" (n) \
-	:"a" (0),"i" (FIRST_TSS_ENTRY<<3))
+
+extern struct tss_struct init_tss;
+
 /*
  *	switch_to(n) should switch tasks to task nr n, first
  * checking that n isn't the current task, in which case it does nothing.
- * This also clears the TS-flag if the task we switched to has used
- * tha math co-processor latest.
+ *
+ * Only what the C code can't save for us is saved: %ebp, the flags,
+ * %fs/%gs and the kernel stack pointer go into the old task's tss-struct
+ * (which is now just a save area), and we continue at label 1 when the
+ * task is switched back in. cr3 is reloaded only if the page-directory
+ * changes. The TS-flag is set unless the new task has used the math
+ * co-processor latest, so math_state_restore() still works lazily.
  */
 #define switch_to(n) {\
-struct {long a,b;} __tmp; \
-// ecx是第n个进程对应的pcb首地址，判断切换的下一个进程是不是就是当前执行的进程，是就不需要切换了
-__asm__("cmpl %%ecx,_current\n\t" \
-	"je 1f\n\t" \
-	// 把第n个进程的tss选择子复制到__tmp.b
-	"movw %%dx,%1\n\t" \
-	// 更新current变量，使current变量执行ecx，ecx指向task[n]
-	"xchgl %%ecx,_current\n\t" \
-	// ljmp 跟一个tss选择子实现进程切换
-	"ljmp %0\n\t" \
-	// 忽略
+if (task[n] != current) { \
+	// 唯一的tss只需要知道下一个进程的内核栈在哪里
+	init_tss.esp0 = task[n]->tss.esp0; \
+	set_ldt_desc(gdt+FIRST_LDT_ENTRY,&(task[n]->ldt)); \
+__asm__("pushfl\n\t" \
+	"cli\n\t" \
+	"pushl %%ebp\n\t" \
+	// 保存当前进程的fs、gs、内核栈和恢复执行的地址，偏移是tss_struct中的位置
+	"movw %%fs,88(%%esi)\n\t" \
+	"movw %%gs,92(%%esi)\n\t" \
+	"movl %%esp,56(%%esi)\n\t" \
+	"movl $1f,32(%%esi)\n\t" \
+	"movl %%ecx,_current\n\t" \
+	// 页目录不同才需要重新加载cr3
+	"movl 28(%%edi),%%eax\n\t" \
+	"cmpl 28(%%esi),%%eax\n\t" \
+	"je 2f\n\t" \
+	"movl %%eax,%%cr3\n" \
+	"2:\tlldt %%dx\n\t" \
+	// 下一个进程最近用过协处理器则清TS，否则置TS
+	"movl %%cr0,%%eax\n\t" \
+	"orl $8,%%eax\n\t" \
 	"cmpl %%ecx,_last_task_used_math\n\t" \
-	"jne 1f\n\t" \
-	"clts\n" \
-	"1:" \
-	::"m" (*&__tmp.a),"m" (*&__tmp.b), \
-	"d" (_TSS(n)),"c" ((long) task[n])); \
+	"jne 3f\n\t" \
+	"andl $0xfffffff7,%%eax\n" \
+	"3:\tmovl %%eax,%%cr0\n\t" \
+	// 换到下一个进程的内核栈，从它上次保存的地址继续执行
+	"movl 56(%%edi),%%esp\n\t" \
+	"movw 88(%%edi),%%fs\n\t" \
+	"movw 92(%%edi),%%gs\n\t" \
+	"jmp *32(%%edi)\n" \
+	"1:\tpopl %%ebp\n\t" \
+	"popfl" \
+	::"S" (&current->tss),"D" (&task[n]->tss), \
+	"c" ((long) task[n]),"d" (_LDT(0)) \
+	:"ax","bx","cx","dx","si","di"); \
+} \
 }
 
 #define PAGE_ALIGN(n) (((n)+0xfff)&0xfffff000)
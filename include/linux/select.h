@@ -0,0 +1,44 @@
+#ifndef _LINUX_SELECT_H
+#define _LINUX_SELECT_H
+
+/*
+ * The wait queues of sleep_on() are chained through the stacks of the
+ * sleepers, so a task can only be on one of them. select() and poll()
+ * have to wait for several objects at once, so pipes and tty queues also
+ * have a list of these, one for each task selecting on them. The entries
+ * live in the select_table on the stack of the selecting task, see
+ * fs/select.c.
+ */
+struct epitem;
+
+struct select_wait {
+	struct task_struct * task;		/* NULL for an epoll entry */
+	struct epitem * item;			/* see fs/eventpoll.c */
+	struct select_wait ** wait_address;	/* list we are on */
+	struct select_wait * next, ** pprev;
+};
+
+// 每个文件描述符最多两个链表（tty的读和写队列）
+#define NR_SELECT (NR_OPEN*2)
+
+/*
+ * The entries are an array of 'max' of them, on the stack of select()
+ * or in an epoll entry ('item' is then set).
+ */
+typedef struct select_table {
+	int nr, max;
+	struct select_wait * entry;
+	struct epitem * item;
+} select_table;
+
+extern void select_wait(struct select_wait ** list, select_table * p);
+extern void select_wake(struct select_wait ** list);
+extern void free_wait(select_table * p);
+extern int poll_file(struct file * file, select_table * wait);
+
+extern void epoll_wake(struct select_wait * entry);
+extern int epoll_poll(struct m_inode * inode, select_table * wait);
+extern void epoll_forget(struct file * file);
+extern void epoll_release(struct m_inode * inode);
+
+#endif
@@ -70,6 +70,25 @@ extern int sys_sgetmask();
 extern int sys_ssetmask();
 extern int sys_setreuid();
 extern int sys_setregid();
+extern int sys_pstat();
+extern int sys_sysenter();
+extern int sys_readv();
+extern int sys_writev();
+extern int sys_pread();
+extern int sys_pwrite();
+extern int sys_sendfile();
+extern int sys_select();
+extern int sys_poll();
+extern int sys_epoll_create();
+extern int sys_epoll_ctl();
+extern int sys_epoll_wait();
+extern int sys_io_setup();
+extern int sys_io_destroy();
+extern int sys_io_submit();
+extern int sys_io_getevents();
+extern int sys_fsync();
+extern int sys_fdatasync();
+extern int sys_getdents();
 
 fn_ptr sys_call_table[] = { sys_setup, sys_exit, sys_fork, sys_read,
 sys_write, sys_open, sys_close, sys_waitpid, sys_creat, sys_link,
@@ -83,4 +102,8 @@ sys_getgid, sys_signal, sys_geteuid, sys_getegid, sys_acct, sys_phys,
 sys_lock, sys_ioctl, sys_fcntl, sys_mpx, sys_setpgid, sys_ulimit,
 sys_uname, sys_umask, sys_chroot, sys_ustat, sys_dup2, sys_getppid,
 sys_getpgrp, sys_setsid, sys_sigaction, sys_sgetmask, sys_ssetmask,
-sys_setreuid,sys_setregid };
+sys_setreuid,sys_setregid, sys_pstat, sys_sysenter, sys_readv,
+sys_writev, sys_pread, sys_pwrite, sys_sendfile, sys_select, sys_poll,
+sys_epoll_create, sys_epoll_ctl, sys_epoll_wait, sys_io_setup,
+sys_io_destroy, sys_io_submit, sys_io_getevents, sys_fsync,
+sys_fdatasync, sys_getdents };
@@ -13,12 +13,17 @@
 
 #define TTY_BUF_SIZE 1024
 
+struct select_wait;
+struct select_table;
+
 struct tty_queue {
 	unsigned long data;
 	unsigned long head;
 	unsigned long tail;
 	struct task_struct * proc_list;
 	char buf[TTY_BUF_SIZE];
+	// 在select()或poll()中等待的进程，放在最后，rs_io.s里用到了前面的偏移
+	struct select_wait * select;
 };
 // 操作环形队列和读写队列里数据的宏
 #define INC(a) ((a) = ((a)+1) & (TTY_BUF_SIZE-1))
@@ -69,6 +74,7 @@ void tty_init(void);
 
 int tty_read(unsigned c, char * buf, int n);
 int tty_write(unsigned c, char * buf, int n);
+int tty_poll(int channel, struct select_table * wait);
 
 void rs_write(struct tty_struct * tty);
 void con_write(struct tty_struct * tty);
@@ -0,0 +1,26 @@
+#ifndef _SYS_AIO_H
+#define _SYS_AIO_H
+
+struct iocb {
+	unsigned long data;	/* handed back in the io_event */
+	int opcode;
+	int fd;
+	char * buf;
+	long nbytes;
+	long offset;
+};
+
+#define IOCB_CMD_PREAD	0
+#define IOCB_CMD_PWRITE	1
+
+struct io_event {
+	unsigned long data;
+	long res;		/* bytes done, or -errno */
+};
+
+extern int io_setup(int nr_events);
+extern int io_destroy(int ctx);
+extern int io_submit(int ctx, int nr, struct iocb ** iocbpp);
+extern int io_getevents(int ctx, int min_nr, int nr, struct io_event * events);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _SYS_EPOLL_H
+#define _SYS_EPOLL_H
+
+struct epoll_event {
+	unsigned long events;
+	unsigned long data;	/* handed back as it was given */
+};
+
+/* the same bits as poll() */
+#define EPOLLIN		0x0001
+#define EPOLLOUT	0x0004
+#define EPOLLERR	0x0008	/* always returned */
+#define EPOLLHUP	0x0010	/* always returned */
+#define EPOLLET		0x80000000	/* edge triggered */
+
+#define EPOLL_CTL_ADD	1
+#define EPOLL_CTL_DEL	2
+#define EPOLL_CTL_MOD	3
+
+extern int epoll_create(int size);
+extern int epoll_ctl(int epfd, int op, int fd, struct epoll_event * event);
+extern int epoll_wait(int epfd, struct epoll_event * events,
+	int maxevents, int timeout);
+
+#endif
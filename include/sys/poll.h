@@ -0,0 +1,19 @@
+#ifndef _SYS_POLL_H
+#define _SYS_POLL_H
+
+struct pollfd {
+	int fd;
+	short events;		/* what to wait for */
+	short revents;		/* what happened */
+};
+
+#define POLLIN		0x0001	/* there is data to read */
+#define POLLPRI		0x0002	/* never set */
+#define POLLOUT		0x0004	/* writing won't block */
+#define POLLERR		0x0008	/* pipe with no readers, always returned */
+#define POLLHUP		0x0010	/* pipe with no writers, always returned */
+#define POLLNVAL	0x0020	/* fd not open, always returned */
+
+extern int poll(struct pollfd * fds, unsigned int nfds, int timeout);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef _PSTAT_H
+#define _PSTAT_H
+
+#include <sys/types.h>
+
+/*
+ * Per-process statistics as returned by pstat(). All times are in
+ * clock ticks.
+ */
+struct pstat {
+	pid_t ps_pid;
+	pid_t ps_ppid;
+	pid_t ps_pgrp;
+	long ps_state;
+	time_t ps_utime;
+	time_t ps_stime;
+	time_t ps_wtime;	/* time spent asleep in sleep_on() */
+	time_t ps_start_time;
+	long ps_nvcsw;		/* voluntary context switches */
+	long ps_nivcsw;		/* involuntary context switches */
+	long ps_minflt;		/* page faults that needed no disk io */
+	long ps_majflt;		/* page faults that read the executable */
+	long ps_inblock;	/* blocks read */
+	long ps_oublock;	/* blocks written */
+};
+
+extern int pstat(struct pstat * buf, int count);
+
+#endif
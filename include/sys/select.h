@@ -0,0 +1,20 @@
+#ifndef _SYS_SELECT_H
+#define _SYS_SELECT_H
+
+#include <sys/time.h>
+
+/*
+ * NR_OPEN is 20, so one long holds a bit for every file descriptor.
+ */
+typedef unsigned long fd_set;
+
+#define FD_SETSIZE	32
+#define FD_SET(fd,fdsetp)	(*(fdsetp) |= (1UL << (fd)))
+#define FD_CLR(fd,fdsetp)	(*(fdsetp) &= ~(1UL << (fd)))
+#define FD_ISSET(fd,fdsetp)	((*(fdsetp) >> (fd)) & 1)
+#define FD_ZERO(fdsetp)		(*(fdsetp) = 0)
+
+extern int select(int nfds, fd_set * readfds, fd_set * writefds,
+	fd_set * exceptfds, struct timeval * timeout);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _SYS_TIME_H
+#define _SYS_TIME_H
+
+struct timeval {
+	long tv_sec;		/* seconds */
+	long tv_usec;		/* microseconds */
+};
+
+#endif
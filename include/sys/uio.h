@@ -0,0 +1,20 @@
+#ifndef _UIO_H
+#define _UIO_H
+
+#include <sys/types.h>
+
+/*
+ * One piece of the buffer readv() and writev() scatter to or gather
+ * from, in the order given.
+ */
+struct iovec {
+	void * iov_base;
+	int iov_len;
+};
+
+#define UIO_MAXIOV	1024
+
+extern int readv(int fildes, const struct iovec * iov, int iovcnt);
+extern int writev(int fildes, const struct iovec * iov, int iovcnt);
+
+#endif
@@ -129,15 +129,49 @@
 #define __NR_ssetmask	69
 #define __NR_setreuid	70
 #define __NR_setregid	71
+#define __NR_pstat	72
+#define __NR_sysenter	73
+#define __NR_readv	74
+#define __NR_writev	75
+#define __NR_pread	76
+#define __NR_pwrite	77
+#define __NR_sendfile	78
+#define __NR_select	79	/* takes a pointer to its five arguments */
+#define __NR_poll	80
+#define __NR_epoll_create	81
+#define __NR_epoll_ctl	82
+#define __NR_epoll_wait	83
+#define __NR_io_setup	84
+#define __NR_io_destroy	85
+#define __NR_io_submit	86
+#define __NR_io_getevents	87
+#define __NR_fsync	88
+#define __NR_fdatasync	89
+#define __NR_getdents	90
+
+/*
+ * The system calls go through the stub __syscall points to, which uses
+ * SYSENTER if the cpu has it (see lib/syscall.c). Code that can't use the
+ * stack (init/main.c before the first fork) defines __SYSCALL_INT to get
+ * the plain 'int $0x80'.
+ */
+#ifdef __SYSCALL_INT
+#define __SYSCALL(n)	"int $0x80"
+#define __SYSCALL_ARG
+#else
+extern long __syscall;
+#define __SYSCALL(n)	"call *%" #n
+#define __SYSCALL_ARG	,"m" (__syscall)
+#endif
 
 #define _syscall0(type,name) \
 type name(void) \
 { \
 long __res; \
-__asm__ volatile ("int $0x80" \
+__asm__ volatile (__SYSCALL(2) \
 	// 输入输出都是eax，输入是系统调用函数在系统调用表的序号
 	: "=a" (__res) \
-	: "0" (__NR_##name)); \
+	: "0" (__NR_##name) __SYSCALL_ARG); \
 if (__res >= 0) \
 	return (type) __res; \
 errno = -__res; \
@@ -148,9 +182,9 @@ return -1; \
 type name(atype a) \
 { \
 long __res; \
-__asm__ volatile ("int $0x80" \
+__asm__ volatile (__SYSCALL(3) \
 	: "=a" (__res) \
-	: "0" (__NR_##name),"b" ((long)(a))); \
+	: "0" (__NR_##name),"b" ((long)(a)) __SYSCALL_ARG); \
 if (__res >= 0) \
 	return (type) __res; \
 errno = -__res; \
@@ -161,9 +195,9 @@ return -1; \
 type name(atype a,btype b) \
 { \
 long __res; \
-__asm__ volatile ("int $0x80" \
+__asm__ volatile (__SYSCALL(4) \
 	: "=a" (__res) \
-	: "0" (__NR_##name),"b" ((long)(a)),"c" ((long)(b))); \
+	: "0" (__NR_##name),"b" ((long)(a)),"c" ((long)(b)) __SYSCALL_ARG); \
 if (__res >= 0) \
 	return (type) __res; \
 errno = -__res; \
@@ -174,9 +208,25 @@ return -1; \
 type name(atype a,btype b,ctype c) \
 { \
 long __res; \
-__asm__ volatile ("int $0x80" \
+__asm__ volatile (__SYSCALL(5) \
+	: "=a" (__res) \
+	: "0" (__NR_##name),"b" ((long)(a)),"c" ((long)(b)),"d" ((long)(c)) \
+	  __SYSCALL_ARG); \
+if (__res>=0) \
+	return (type) __res; \
+errno=-__res; \
+return -1; \
+}
+
+/* the fourth argument goes in %esi */
+#define _syscall4(type,name,atype,a,btype,b,ctype,c,dtype,d) \
+type name(atype a,btype b,ctype c,dtype d) \
+{ \
+long __res; \
+__asm__ volatile (__SYSCALL(6) \
 	: "=a" (__res) \
-	: "0" (__NR_##name),"b" ((long)(a)),"c" ((long)(b)),"d" ((long)(c))); \
+	: "0" (__NR_##name),"b" ((long)(a)),"c" ((long)(b)),"d" ((long)(c)), \
+	  "S" ((long)(d)) __SYSCALL_ARG); \
 if (__res>=0) \
 	return (type) __res; \
 errno=-__res; \
@@ -250,5 +300,10 @@ int dup2(int oldfd, int newfd);
 int getppid(void);
 pid_t getpgrp(void);
 pid_t setsid(void);
+int pread(int fildes, char * buf, int count, off_t offset);
+int pwrite(int fildes, const char * buf, int count, off_t offset);
+int sendfile(int out_fd, int in_fd, off_t * offset, int count);
+int fsync(int fildes);
+int fdatasync(int fildes);
 
 #endif
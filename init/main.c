@@ -5,6 +5,8 @@
  */
 
 #define __LIBRARY__
+// fork()和pause()不能用栈，所以不经过lib/syscall.c的sysenter
+#define __SYSCALL_INT
 #include <unistd.h>
 #include <time.h>
 
@@ -128,6 +130,8 @@ void main(void)		/* This really IS void, no error here. */
 #ifdef RAMDISK
 	main_memory_start += rd_init(main_memory_start, RAMDISK*1024);
 #endif
+	// inode表放在主存的开头，大小根据内存大小决定
+	main_memory_start += inode_init(main_memory_start,memory_end);
 	// 初始化主存
 	mem_init(main_memory_start,memory_end);
 	// 注册中断处理函数
@@ -144,6 +148,8 @@ void main(void)		/* This really IS void, no error here. */
 	sched_init();
 	// 缓存区初始化
 	buffer_init(buffer_memory_end);
+	// 目录项缓存初始化
+	dcache_init();
 	// 硬盘初始化
 	hd_init();
 	// 软盘初始化
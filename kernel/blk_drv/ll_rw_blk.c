@@ -153,6 +153,11 @@ repeat:
 	req->waiting = NULL;
 	req->bh = bh;
 	req->next = NULL;
+	// 记在发起读写的进程头上
+	if (rw == READ)
+		current->inblock++;
+	else
+		current->oublock++;
 	// 插入请求队列
 	add_request(major+blk_dev,req);
 }
@@ -23,6 +23,7 @@ head = 4
 tail = 8
 proc_list = 12
 buf = 16
+select = buf+size		/* see tty.h */
 
 startup	= 256		/* chars left in write queue when we restart it */
 
@@ -119,6 +120,7 @@ write_char:
 	je write_buffer_empty
 	cmpl $startup,%ebx
 	ja 1f
+	call wake_select
 	movl proc_list(%ecx),%ebx	# wake up sleeping process
 	testl %ebx,%ebx			# is there any?
 	je 1f
@@ -134,6 +136,7 @@ write_char:
 	ret
 .align 2
 write_buffer_empty:
+	call wake_select
 	movl proc_list(%ecx),%ebx	# wake up sleeping process
 	testl %ebx,%ebx			# is there any?
 	je 1f
@@ -145,3 +148,23 @@ write_buffer_empty:
 1:	andb $0xd,%al		/* disable transmit interrupt */
 	outb %al,%dx
 	ret
+
+/*
+ * Wakes up the processes in select() on the write queue in %ecx. The C
+ * function may change %eax, %ecx and %edx, which we still need.
+ */
+.align 2
+wake_select:
+	cmpl $0,select(%ecx)
+	je 1f
+	pushl %eax
+	pushl %ecx
+	pushl %edx
+	leal select(%ecx),%eax
+	pushl %eax
+	call _select_wake
+	addl $4,%esp
+	popl %edx
+	popl %ecx
+	popl %eax
+1:	ret
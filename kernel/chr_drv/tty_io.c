@@ -13,6 +13,8 @@
 #include <ctype.h>
 #include <errno.h>
 #include <signal.h>
+#include <string.h>
+#include <sys/poll.h>
 
 #define ALRMMASK (1<<(SIGALRM-1))
 #define KILLMASK (1<<(SIGKILL-1))
@@ -22,6 +24,7 @@
 
 #include <linux/sched.h>
 #include <linux/tty.h>
+#include <linux/select.h>
 #include <asm/segment.h>
 #include <asm/system.h>
 // 判断f位是否为1
@@ -111,13 +114,13 @@ void tty_init(void)
 // 给某个进程组内的所有进程发送mask信息
 void tty_intr(struct tty_struct * tty, int mask)
 {
-	int i;
+	struct task_struct * p;
 
 	if (tty->pgrp <= 0)
 		return;
-	for (i=0;i<NR_TASKS;i++)
-		if (task[i] && task[i]->pgrp==tty->pgrp)
-			task[i]->signal |= mask;
+	for (p = pgrp_hash(tty->pgrp) ; p ; p = p->pgrp_next)
+		if (p->pgrp==tty->pgrp)
+			p->signal |= mask;
 }
 
 static void sleep_if_empty(struct tty_queue * queue)
@@ -251,6 +254,30 @@ void copy_to_cooked(struct tty_struct * tty)
 		PUTCH(c,tty->secondary);
 	}
 	wake_up(&tty->secondary.proc_list);
+	select_wake(&tty->secondary.select);
+}
+
+/*
+ * What select() and poll() see of a tty, see fs/select.c. The tests are
+ * the ones tty_read() and tty_write() use to decide to sleep.
+ */
+int tty_poll(int channel, select_table * wait)
+{
+	struct tty_struct * tty;
+	int mask = 0;
+
+	if (channel < 0 || channel > 2)
+		return POLLERR;
+	tty = tty_table + channel;
+	select_wait(&tty->secondary.select,wait);
+	select_wait(&tty->write_q.select,wait);
+	// 规范模式下要有一整行才可读
+	if (!EMPTY(tty->secondary) && (!L_CANON(tty) ||
+	    tty->secondary.data || LEFT(tty->secondary) <= 20))
+		mask |= POLLIN;
+	if (!FULL(tty->write_q))
+		mask |= POLLOUT;
+	return mask;
 }
 
 int tty_read(unsigned channel, char * buf, int nr)
@@ -324,7 +351,8 @@ int tty_write(unsigned channel, char * buf, int nr)
 {
 	static cr_flag=0;
 	struct tty_struct * tty;
-	char c, *b=buf;
+	char c, *b=buf, tmp[64];
+	int n, m;
 
 	if (channel>2 || nr<0) return -1;
 	tty = channel + tty_table;
@@ -334,6 +362,35 @@ int tty_write(unsigned channel, char * buf, int nr)
 		// 有信号需要处理
 		if (current->signal)
 			break;
+		/*
+			不做输出处理时，一段一段地整块复制到写队列里。复制用户数据可能
+			缺页睡眠，不能关着中断做，所以先复制到栈上，关中断后只做内核里的
+			复制（回显是在中断里放进写队列的）
+		*/
+		if (!O_POST(tty))
+			while (nr>0 && !FULL(tty->write_q)) {
+				n = LEFT(tty->write_q);
+				if (n > sizeof(tmp))
+					n = sizeof(tmp);
+				if (n > nr)
+					n = nr;
+				memcpy_fromfs(tmp,b,n);
+				cli();
+				// 睡眠时回显可能占了一些空间
+				if (n > LEFT(tty->write_q))
+					n = LEFT(tty->write_q);
+				m = TTY_BUF_SIZE - tty->write_q.head;
+				if (m > n)
+					m = n;
+				memcpy(tty->write_q.buf+tty->write_q.head,tmp,m);
+				memcpy(tty->write_q.buf,tmp+m,n-m);
+				tty->write_q.head = (tty->write_q.head+n) &
+					(TTY_BUF_SIZE-1);
+				sti();
+				b += n;
+				nr -= n;
+				cr_flag = 0;
+			}
 		// 还没写完并且还有空间可以写
 		while (nr>0 && !FULL(tty->write_q)) {
 			c=get_fs_byte(b);
@@ -23,9 +23,18 @@ void release(struct task_struct * p)
 
 	if (!p)
 		return;
-	for (i=1 ; i<NR_TASKS ; i++)
+	for (i=1 ; i<nr_tasks ; i++)
 		if (task[i]==p) {
-			task[i]=NULL;
+			free_task_slot(i);
+			// 从进程树和哈希链中摘掉，pid可以再分配了
+			if (p->p_pptr)
+				REMOVE_LINKS(p);
+			unhash_pid(p);
+			detach_pgrp(p);
+			detach_session(p);
+			free_pid(p->pid);
+			// 进程不会再运行了，可以释放它的页目录
+			free_page_dir(p);
 			free_page((long)p);
 			schedule();
 			return;
@@ -50,12 +59,24 @@ static inline int send_sig(long sig,struct task_struct * p,int priv)
 // 结束会话，给该会话的所有进程发SIGHUP信号,因为子进程会继承父进程的sessionid，所以if可能会多次成立
 static void kill_session(void)
 {
-	struct task_struct **p = NR_TASKS + task;
-	
-	while (--p > &FIRST_TASK) {
-		if (*p && (*p)->session == current->session)
-			(*p)->signal |= 1<<(SIGHUP-1);
-	}
+	struct task_struct *p;
+
+	for (p = session_hash(current->session) ; p ; p = p->session_next)
+		if (p->session == current->session)
+			p->signal |= 1<<(SIGHUP-1);
+}
+
+// 给进程组pgrp里的所有进程发信号，只遍历哈希链上的进程
+int kill_pg(int pgrp, int sig, int priv)
+{
+	struct task_struct *p;
+	int err, retval = 0;
+
+	for (p = pgrp_hash(pgrp) ; p ; p = p->pgrp_next)
+		if (p->pgrp == pgrp)
+			if (err = send_sig(sig,p,priv))
+				retval = err;
+	return retval;
 }
 
 /*
@@ -64,42 +85,30 @@ static void kill_session(void)
  */
 int sys_kill(int pid,int sig)
 {
-	struct task_struct **p = NR_TASKS + task;
+	struct task_struct **p = nr_tasks + task;
+	struct task_struct *t;
 	int err, retval = 0;
 	// pid等于0则给当前进程的整个组发信号，大于0则给某个进程发信号，-1则给全部进程发，小于-1则给某个组发信号
-	if (!pid) while (--p > &FIRST_TASK) {
-		if (*p && (*p)->pgrp == current->pid) 
-			if (err=send_sig(sig,*p,1))
-				retval = err;
-	} else if (pid>0) while (--p > &FIRST_TASK) {
-		if (*p && (*p)->pid == pid) 
-			if (err=send_sig(sig,*p,0))
-				retval = err;
-	} else if (pid == -1) while (--p > &FIRST_TASK)
-		if (err = send_sig(sig,*p,0))
+	if (!pid)
+		return kill_pg(current->pgrp,sig,1);
+	if (pid>0)
+		return (t = find_task_by_pid(pid)) ? send_sig(sig,t,0) : 0;
+	if (pid != -1)
+		return kill_pg(-pid,sig,0);
+	while (--p > &FIRST_TASK)
+		if (*p && (err = send_sig(sig,*p,0)))
 			retval = err;
-	else while (--p > &FIRST_TASK)
-		if (*p && (*p)->pgrp == -pid)
-			if (err = send_sig(sig,*p,0))
-				retval = err;
 	return retval;
 }
 
-// 子进程退出，通知进程id是pid的父进程
-static void tell_father(int pid)
+// 子进程退出，通知父进程
+static void tell_father(struct task_struct * father)
 {
-	int i;
-
-	if (pid)
-		for (i=0;i<NR_TASKS;i++) {
-			if (!task[i])
-				continue;
-			if (task[i]->pid != pid)
-				continue;
-			// 根据pid找到父进程，设置子进程退出的信号
-			task[i]->signal |= (1<<(SIGCHLD-1));
-			return;
-		}
+	if (father) {
+		// 设置子进程退出的信号
+		father->signal |= (1<<(SIGCHLD-1));
+		return;
+	}
 /* if we don't find any fathers, we just release ourselves */
 /* This is not really OK. Must change it to make father 1 */
 	printk("BAD BAD - no father found\n\r");
@@ -109,26 +118,31 @@ static void tell_father(int pid)
 
 int do_exit(long code)
 {
+	struct task_struct * p;
 	int i;
 	// 释放代码段和数据段页表,页目录，物理地址
 	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
 	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
-	for (i=0 ; i<NR_TASKS ; i++)
-		// 找出当前进程的子进程
-		if (task[i] && task[i]->father == current->pid) {
-			// 子进程的新父进程是进程id为1的进程
-			task[i]->father = 1;
-			/*
-			 父进程没有调wait，子进程退出了，然后父进程也退出了。没人回收子进程的pcb，给init进程发
-			*/
-			if (task[i]->state == TASK_ZOMBIE)
-				/* assumption task[1] is always init */
-				(void) send_sig(SIGCHLD, task[1], 1);
-		}
+	// 遍历当前进程的子进程链表，全部过继给进程1
+	while (p = current->p_cptr) {
+		REMOVE_LINKS(p);
+		// 子进程的新父进程是进程id为1的进程
+		p->father = 1;
+		p->p_pptr = task[1];
+		SET_LINKS(p);
+		/*
+		 父进程没有调wait，子进程退出了，然后父进程也退出了。没人回收子进程的pcb，给init进程发
+		*/
+		if (p->state == TASK_ZOMBIE)
+			/* assumption task[1] is always init */
+			(void) send_sig(SIGCHLD, task[1], 1);
+	}
 	// 关闭文件
 	for (i=0 ; i<NR_OPEN ; i++)
 		if (current->filp[i])
 			sys_close(i);
+	// 等还没收回的异步读写做完，释放它们占着的buffer
+	aio_exit();
 	// 回写inode到硬盘
 	iput(current->pwd);
 	current->pwd=NULL;
@@ -148,7 +162,7 @@ int do_exit(long code)
 	current->state = TASK_ZOMBIE;
 	current->exit_code = code;
 	// 通知父进程
-	tell_father(current->father);
+	tell_father(current->p_pptr);
 	// 重新调度进程
 	schedule();
 	return (-1);	/* just to suppress warnings */
@@ -162,50 +176,45 @@ int sys_exit(int error_code)
 int sys_waitpid(pid_t pid,unsigned long * stat_addr, int options)
 {
 	int flag, code;
-	struct task_struct ** p;
+	struct task_struct * p;
 
 	verify_area(stat_addr,4);
 repeat:
 	flag=0;
-	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
-		// 过滤不符合条件的
-		if (!*p || *p == current)
-			continue;
-		// 不是当前进程的子进程则跳过
-		if ((*p)->father != current->pid)
-			continue;
+	// 只需要遍历当前进程的子进程链表
+	for (p = current->p_cptr ; p ; p = p->p_osptr) {
 		// pid大于0说明等待某一个子进程
 		if (pid>0) {
 			// 不是等待的子进程则跳过
-			if ((*p)->pid != pid)
+			if (p->pid != pid)
 				continue;
 		} else if (!pid) {
 			// pid等于0则等待进程组中的进程，不是当前进程组的进程则跳过
-			if ((*p)->pgrp != current->pgrp)
+			if (p->pgrp != current->pgrp)
 				continue;
 		} else if (pid != -1) {
 			// 不等于-1说明是等待某一个组的，但不是当前进程的组，组id是-pid的组，不是该组则跳过
-			if ((*p)->pgrp != -pid)
+			if (p->pgrp != -pid)
 				continue;
 		} 
 		// else {
 		//	等待所有进程
 		// }
 		// 找到了一个符合条件的进程
-		switch ((*p)->state) {
+		switch (p->state) {
 			// 子进程已经退出,这个版本没有这个状态
 			case TASK_STOPPED:
 				if (!(options & WUNTRACED))
 					continue;
 				put_fs_long(0x7f,stat_addr);
-				return (*p)->pid;
+				return p->pid;
 			case TASK_ZOMBIE:
 				// 子进程已经退出，则返回父进程
-				current->cutime += (*p)->utime;
-				current->cstime += (*p)->stime;
-				flag = (*p)->pid;
-				code = (*p)->exit_code;
-				release(*p);
+				current->cutime += p->utime;
+				current->cstime += p->stime;
+				flag = p->pid;
+				code = p->exit_code;
+				release(p);
 				put_fs_long(code,stat_addr);
 				return flag;
 			default:
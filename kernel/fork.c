@@ -18,8 +18,34 @@
 #include <asm/system.h>
 
 extern void write_verify(unsigned long address);
+extern void ret_from_fork(void);
 
-long last_pid=0;
+extern long last_pid;
+
+/*
+ * Free task-table slots are kept on a stack, so fork doesn't have to
+ * search the (now rather big) task-table. The lowest slots are handed
+ * out first, which keeps nr_tasks - and the scheduler loops - short.
+ */
+static unsigned short free_slots[NR_TASKS];
+static int nr_free_slots = 0;
+
+void task_slot_init(void)
+{
+	int i;
+
+	for (i=NR_TASKS-1 ; i>0 ; i--)
+		free_slots[nr_free_slots++] = i;
+}
+
+// 归还task[nr]，同时缩小nr_tasks
+void free_task_slot(int nr)
+{
+	task[nr] = NULL;
+	free_slots[nr_free_slots++] = nr;
+	while (nr_tasks > 1 && !task[nr_tasks-1])
+		nr_tasks--;
+}
 
 void verify_area(void * addr,int size)
 {
@@ -50,15 +76,18 @@ int copy_mem(int nr,struct task_struct * p)
 		panic("We don't support separate I&D");
 	if (data_limit < code_limit)
 		panic("Bad data_limit");
-	// 设置进程的线性地址的首地址，每个进程占64MB
-	new_data_base = new_code_base = nr * 0x4000000;
+	// 每个进程有自己的页目录，线性地址都从USER_BASE开始
+	new_data_base = new_code_base = USER_BASE;
 	p->start_code = new_code_base;
 	// 设置线性地址到ldt的描述符中
 	set_base(p->ldt[1],new_code_base);
 	set_base(p->ldt[2],new_data_base);
-	// 把父进程的页目录项和页表复制到子进程,old_data_base,new_data_base是线性地址,父子进程共享物理页面，即copy on write
-	if (copy_page_tables(old_data_base,new_data_base,data_limit)) {
-		free_page_tables(new_data_base,data_limit);
+	// 新的页目录，内核部分和进程0共享
+	if (!(p->tss.cr3 = new_page_dir()))
+		return -ENOMEM;
+	// 把父进程的页目录项和页表复制到子进程的页目录,父子进程共享物理页面，即copy on write
+	if (copy_page_tables(old_data_base,new_data_base,data_limit,p)) {
+		free_page_dir(p);
 		return -ENOMEM;
 	}
 	return 0;
@@ -77,12 +106,18 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	struct task_struct *p;
 	int i;
 	struct file *f;
+	long * krnl_stack;
 	// 申请一页存pcb
 	p = (struct task_struct *) get_free_page();
-	if (!p)
+	if (!p) {
+		free_task_slot(nr);
+		free_pid(last_pid);
 		return -EAGAIN;
+	}
 	// 挂载到全局pcb数组
 	task[nr] = p;
+	if (nr >= nr_tasks)
+		nr_tasks = nr+1;
 	// 复制当前进程的数据
 	*p = *current;	/* NOTE! this doesn't copy the supervisor stack */
 	p->state = TASK_UNINTERRUPTIBLE;
@@ -94,53 +129,56 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	p->leader = 0;		/* process leadership doesn't inherit */
 	p->utime = p->stime = 0;
 	p->cutime = p->cstime = 0;
+	p->nvcsw = p->nivcsw = 0;
+	p->min_flt = p->maj_flt = 0;
+	p->inblock = p->oublock = 0;
+	p->wtime = 0;
+	p->timeout = 0;
 	// 当前时间
 	p->start_time = jiffies;
-	p->tss.back_link = 0;
 	// 内核栈，在页末
 	p->tss.esp0 = PAGE_SIZE + (long) p;
 	p->tss.ss0 = 0x10;
-	// 调用fork时压入栈的ip，子进程创建完成会从这开始执行，即if (__res >= 0) 
-	p->tss.eip = eip;
-	p->tss.eflags = eflags;
-	// 子进程从fork返回的是0，eax会赋值给__res
-	p->tss.eax = 0;
-	p->tss.ecx = ecx;
-	p->tss.edx = edx;
-	p->tss.ebx = ebx;
-	p->tss.esp = esp;
-	p->tss.ebp = ebp;
-	p->tss.esi = esi;
-	p->tss.edi = edi;
-	// 段选择子是16位
-	p->tss.es = es & 0xffff;
-	p->tss.cs = cs & 0xffff;
-	p->tss.ss = ss & 0xffff;
-	p->tss.ds = ds & 0xffff;
 	p->tss.fs = fs & 0xffff;
 	p->tss.gs = gs & 0xffff;
 	/*
-		计算第nr进程在GDT中关于LDT的索引，切换任务的时候，
-		这个索引会被加载到ldt寄存器，cpu会自动根据ldt的值，把
-		GDT中相应位置的段描述符加载到ldt寄存器(共16+32+16位)
+		子进程第一次被switch_to切换进来时从ret_from_fork开始执行，
+		它按系统调用返回的格式弹出这些寄存器，然后iret回到用户态fork返回的地方，
+		即if (__res >= 0)
 	*/
-	p->tss.ldt = _LDT(nr); 
-	p->tss.trace_bitmap = 0x80000000;
+	krnl_stack = (long *) (PAGE_SIZE + (long) p);
+	*--krnl_stack = ss & 0xffff;
+	*--krnl_stack = esp;
+	*--krnl_stack = eflags;
+	*--krnl_stack = cs & 0xffff;
+	*--krnl_stack = eip;
+	*--krnl_stack = ds & 0xffff;
+	*--krnl_stack = es & 0xffff;
+	*--krnl_stack = fs & 0xffff;
+	*--krnl_stack = edx;
+	*--krnl_stack = ecx;
+	*--krnl_stack = ebx;
+	// 子进程从fork返回的是0，eax会赋值给__res
+	*--krnl_stack = 0;
+	*--krnl_stack = esi;
+	*--krnl_stack = edi;
+	*--krnl_stack = ebp;
+	p->tss.esp = (long) krnl_stack;
+	p->tss.eip = (long) ret_from_fork;
 	if (last_task_used_math == current)
 		__asm__("clts ; fnsave %0"::"m" (p->tss.i387));
 	/*
-	设置线性地址范围，挂载线性地址首地址和限长到ldt，赋值页目录项和页表
-	执行进程的时候，tss选择子被加载到tss寄存器，然后把tss里的上下文
-	也加载到对应的寄存器，比如cr3，ldt选择子。tss信息中的ldt索引首先从gdt找到进程ldt
-	结构体数据的首地址，然后根据当前段的属性，比如代码段，
-	则从cs中取得选择子，系统从ldt表中取得进程线性空间
-	的首地址、限长、权限等信息。用线性地址的首地址加上ip
+	设置线性地址范围，挂载线性地址首地址和限长到ldt，复制页目录项和页表。
+	切换到该进程的时候，switch_to把GDT中的ldt描述符指向进程的ldt，
+	再把它加载到ldt寄存器，同时把页目录的地址加载到cr3。之后cpu根据
+	段选择子从ldt表中取得进程线性空间的首地址、限长、权限等信息。用线性地址的首地址加上ip
 	中的偏移，得到线性地址，然后再通过页目录和页表得到物理
 	地址，物理地址还没有分配则进行缺页异常等处理。
 	*/
 	if (copy_mem(nr,p)) {
-		task[nr] = NULL;
+		free_task_slot(nr);
 		free_page((long) p);
+		free_pid(last_pid);
 		return -EAGAIN;
 	}
 	// 父子进程都有同样的文件描述符，file结构体加一
@@ -154,12 +192,13 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 		current->root->i_count++;
 	if (current->executable)
 		current->executable->i_count++;
-	/*
-		挂载tss和ldt地址到gdt，nr << 1即乘以2，这里算出的是第nr个进程距离第一个tss描述符地址的偏移，
-		单位是8个字节，即选择描述符大小,_LDT是偏移的大小，单位是1，这里是8
-	*/
-	set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY,&(p->tss));
-	set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&(p->ldt));
+	// 链接字段是从父进程复制过来的，这里重新挂到进程树和各个哈希链上
+	p->p_pptr = current;
+	p->p_cptr = NULL;
+	SET_LINKS(p);
+	hash_pid(p);
+	attach_pgrp(p);
+	attach_session(p);
 	p->state = TASK_RUNNING;	/* do this last, just in case */
 	return last_pid;
 }
@@ -168,15 +207,14 @@ int find_empty_process(void)
 {
 	int i;
 
-	repeat:
-		// 先找到一个可用的pid
-		if ((++last_pid)<0) last_pid=1;
-		for(i=0 ; i<NR_TASKS ; i++)
-			if (task[i] && task[i]->pid == last_pid) goto repeat;
-	// 再找一个可用的pcb项，从1开始，0是init进程
-	for(i=1 ; i<NR_TASKS ; i++)
-		if (!task[i])
-			return i;
-	return -EAGAIN;
+	// 先从空闲槽位栈中取一个可用的pcb项，0是init进程，不在栈里
+	if (!nr_free_slots)
+		return -EAGAIN;
+	i = free_slots[--nr_free_slots];
+	// 再从pid位图中分配一个pid，copy_process通过last_pid拿到它
+	if (alloc_pid() < 0) {
+		free_slots[nr_free_slots++] = i;
+		return -EAGAIN;
+	}
+	return i;
 }
-		
\ No newline at end of file
@@ -0,0 +1,156 @@
+/*
+ *  linux/kernel/pid.c
+ */
+
+/*
+ * 'pid.c' keeps the pid bitmap and the pid/pgrp/session hash chains,
+ * so that fork, exit, wait and kill only touch the tasks they are
+ * interested in instead of scanning the whole task-table.
+ *
+ * Task 0 is only put in the pid-hash: it is never part of a process
+ * group or session as far as kill() etc are concerned.
+ */
+#include <errno.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+
+// 最近一次分配的pid，下次从它后面开始找
+long last_pid=0;
+// pid位图，一位对应一个pid，置1说明已被使用
+static unsigned long pid_map[PID_MAX/32] = {0,};
+
+struct task_struct * pidhash[PIDHASH_SZ];
+struct task_struct * pgrphash[PIDHASH_SZ];
+struct task_struct * sesshash[PIDHASH_SZ];
+
+// 头插法插入哈希链，pprev指向前一个节点的next字段（或者链表头），删除时不需要遍历
+void hash_pid(struct task_struct * p)
+{
+	struct task_struct ** head = &pidhash[pid_hashfn(p->pid)];
+
+	if ((p->pidhash_next = *head) != NULL)
+		(*head)->pidhash_pprev = &p->pidhash_next;
+	*head = p;
+	p->pidhash_pprev = head;
+}
+
+void unhash_pid(struct task_struct * p)
+{
+	if (!p->pidhash_pprev)
+		return;
+	if (p->pidhash_next)
+		p->pidhash_next->pidhash_pprev = p->pidhash_pprev;
+	*p->pidhash_pprev = p->pidhash_next;
+	p->pidhash_pprev = NULL;
+}
+
+void attach_pgrp(struct task_struct * p)
+{
+	struct task_struct ** head = &pgrphash[pid_hashfn(p->pgrp)];
+
+	if ((p->pgrp_next = *head) != NULL)
+		(*head)->pgrp_pprev = &p->pgrp_next;
+	*head = p;
+	p->pgrp_pprev = head;
+}
+
+void detach_pgrp(struct task_struct * p)
+{
+	if (!p->pgrp_pprev)
+		return;
+	if (p->pgrp_next)
+		p->pgrp_next->pgrp_pprev = p->pgrp_pprev;
+	*p->pgrp_pprev = p->pgrp_next;
+	p->pgrp_pprev = NULL;
+}
+
+void attach_session(struct task_struct * p)
+{
+	struct task_struct ** head = &sesshash[pid_hashfn(p->session)];
+
+	if ((p->session_next = *head) != NULL)
+		(*head)->session_pprev = &p->session_next;
+	*head = p;
+	p->session_pprev = head;
+}
+
+void detach_session(struct task_struct * p)
+{
+	if (!p->session_pprev)
+		return;
+	if (p->session_next)
+		p->session_next->session_pprev = p->session_pprev;
+	*p->session_pprev = p->session_next;
+	p->session_pprev = NULL;
+}
+
+// 根据pid在哈希链中找到对应的进程
+struct task_struct * find_task_by_pid(int pid)
+{
+	struct task_struct * p;
+
+	for (p = pidhash[pid_hashfn(pid)] ; p ; p = p->pidhash_next)
+		if (p->pid == pid)
+			return p;
+	return NULL;
+}
+
+/*
+ * A pid that is still used as a process group or session id must not
+ * be handed out again, or the new process would suddenly find itself
+ * the leader of somebody else's group.
+ */
+static int pid_in_use(int pid)
+{
+	struct task_struct * p;
+
+	for (p = pgrphash[pid_hashfn(pid)] ; p ; p = p->pgrp_next)
+		if (p->pgrp == pid)
+			return 1;
+	for (p = sesshash[pid_hashfn(pid)] ; p ; p = p->session_next)
+		if (p->session == pid)
+			return 1;
+	return 0;
+}
+
+// 从last_pid后面开始找第一个空闲的pid，全1的字直接跳过
+int alloc_pid(void)
+{
+	int pid = last_pid, n;
+
+	for (n = 0 ; n < PID_MAX ; n++) {
+		if (++pid >= PID_MAX)
+			pid = 1;
+		if (pid_map[pid>>5] == 0xffffffff) {
+			n += 31 - (pid & 31);
+			pid |= 31;
+			continue;
+		}
+		if (pid_map[pid>>5] & (1 << (pid & 31)))
+			continue;
+		if (pid_in_use(pid))
+			continue;
+		pid_map[pid>>5] |= 1 << (pid & 31);
+		return last_pid = pid;
+	}
+	return -EAGAIN;
+}
+
+void free_pid(int pid)
+{
+	if (pid <= 0 || pid >= PID_MAX)
+		return;
+	pid_map[pid>>5] &= ~(1 << (pid & 31));
+}
+
+// 进程0的pid占住位图的第0位，并放入pid哈希链
+void pid_init(void)
+{
+	int i;
+
+	for (i=0 ; i<PIDHASH_SZ ; i++)
+		pidhash[i] = pgrphash[i] = sesshash[i] = NULL;
+	pid_map[0] |= 1;
+	hash_pid(task[0]);
+}
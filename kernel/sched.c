@@ -33,13 +33,17 @@ void show_task(int nr,struct task_struct * p)
 	while (i<j && !((char *)(p+1))[i])
 		i++;
 	printk("%d (of %d) chars free in kernel stack\n\r",i,j);
+	// 切换次数、缺页次数、读写的块数和睡眠的时间
+	printk("   csw=%d/%d, flt=%d/%d, blk=%d/%d, time=%d/%d/%d\n\r",
+		p->nvcsw,p->nivcsw,p->min_flt,p->maj_flt,p->inblock,p->oublock,
+		p->utime,p->stime,p->wtime);
 }
 
 void show_stat(void)
 {
 	int i;
 
-	for (i=0;i<NR_TASKS;i++)
+	for (i=0;i<nr_tasks;i++)
 		if (task[i])
 			show_task(i,task[i]);
 }
@@ -64,6 +68,18 @@ struct task_struct *current = &(init_task.task);
 struct task_struct *last_task_used_math = NULL;
 
 struct task_struct * task[NR_TASKS] = {&(init_task.task), };
+int nr_tasks = 1;
+
+/*
+ * The one and only TSS. Only esp0/ss0 and the io-bitmap offset matter,
+ * switch_to() keeps esp0 pointing at the current task's kernel stack.
+ */
+struct tss_struct init_tss = {0,PAGE_SIZE+(long)&init_task,0x10,0,0,0,0,(long)&pg_dir,
+	0,0,0,0,0,0,0,0,
+	0,0,0x17,0x17,0x17,0x17,0x17,0x17,
+	_LDT(0),0x80000000,
+	{}
+};
 
 long user_stack [ PAGE_SIZE>>2 ] ;
 
@@ -119,6 +135,12 @@ void schedule(void)
 					(*p)->signal |= (1<<(SIGALRM-1));
 					(*p)->alarm = 0;
 				}
+			// select()和poll()的超时时间到了
+			if ((*p)->timeout && (*p)->timeout <= jiffies) {
+				(*p)->timeout = 0;
+				if ((*p)->state == TASK_INTERRUPTIBLE)
+					(*p)->state = TASK_RUNNING;
+			}
 			/*
 				_BLOCKABLE为可以阻塞的信号集合，blocked为当前进程设置的阻塞集合，相与
 				得到进程当前阻塞的集合，即排除进程阻塞了不能阻塞的信号，然后取反得到可以接收的
@@ -134,8 +156,8 @@ void schedule(void)
 	while (1) {
 		c = -1;
 		next = 0;
-		i = NR_TASKS;
-		p = &task[NR_TASKS];
+		i = nr_tasks;
+		p = &task[nr_tasks];
 		while (--i) {
 			if (!*--p)
 				continue;
@@ -156,6 +178,13 @@ void schedule(void)
 				(*p)->counter = ((*p)->counter >> 1) +
 						(*p)->priority;
 	}
+	// 当前进程还是可运行的，说明是时间片用完被抢占的，否则是自己睡眠让出cpu
+	if (task[next] != current) {
+		if (current->state == TASK_RUNNING)
+			current->nivcsw++;
+		else
+			current->nvcsw++;
+	}
 	// 切换进程
 	switch_to(next);
 }
@@ -170,6 +199,7 @@ int sys_pause(void)
 void sleep_on(struct task_struct **p)
 {
 	struct task_struct *tmp;
+	long start;
 
 	if (!p)
 		return;
@@ -189,7 +219,9 @@ void sleep_on(struct task_struct **p)
 	*p = current;
 	// 不可中断睡眠只能通过wake_up唤醒，即使有信号也无法唤醒
 	current->state = TASK_UNINTERRUPTIBLE;
+	start = jiffies;
 	schedule();
+	current->wtime += jiffies - start;
 	// 唤醒后面一个节点
 	if (tmp)
 		tmp->state=0;
@@ -198,6 +230,7 @@ void sleep_on(struct task_struct **p)
 void interruptible_sleep_on(struct task_struct **p)
 {
 	struct task_struct *tmp;
+	long start;
 
 	if (!p)
 		return;
@@ -212,7 +245,9 @@ void interruptible_sleep_on(struct task_struct **p)
 	链表后，还有没有进程也插入了该链表
 */
 repeat:	current->state = TASK_INTERRUPTIBLE;
+	start = jiffies;
 	schedule();
+	current->wtime += jiffies - start;
 	/*
 		这里为true，说明是信号唤醒，因为wake_up能保证唤醒的是第一个节点，
 		这里先唤醒链表中比当前进程后插入链表的节点，有点奇怪，自己被信号唤醒了，
@@ -470,30 +505,22 @@ int sys_nice(long increment)
 void sched_init(void)
 {
 	int i;
-	struct desc_struct * p;
 
 	if (sizeof(struct sigaction) != 16)
 		panic("Struct sigaction MUST be 16 bytes");
-	// 设置进程0在gdt中的tss和ldt描述符
-	set_tss_desc(gdt+FIRST_TSS_ENTRY,&(init_task.task.tss));
+	// 设置gdt中唯一的tss描述符和进程0的ldt描述符
+	set_tss_desc(gdt+FIRST_TSS_ENTRY,&init_tss);
 	set_ldt_desc(gdt+FIRST_LDT_ENTRY,&(init_task.task.ldt));
-	// 初始化剩下的tss和ldt项
-	p = gdt+2+FIRST_TSS_ENTRY;
-	// 一个进程一项，所以值需要处理一部分
-	for(i=1;i<NR_TASKS;i++) {
-		// 清空pcb数组
+	// 进程0放入pid哈希链
+	pid_init();
+	for(i=1;i<NR_TASKS;i++)
 		task[i] = NULL;
-		// tss段描述符清0
-		p->a=p->b=0;
-		p++;
-		// ldt描述符清0
-		p->a=p->b=0;
-		p++;
-	}
+	// 空闲槽位链表
+	task_slot_init();
 /* Clear NT, so that we won't have troubles with that later on */
 	// 压栈eflags寄存器到栈，修改压栈的内容，清NT位，再回写到eflags中，NT是标记当前执行的任务是否是嵌套的任务，比如通过call调用的则置1
 	__asm__("pushfl ; andl $0xffffbfff,(%esp) ; popfl");
-	// 加载第一个任务的tss选择子到tr寄存器，然后cpu会找到GDT中的描述符，把基地址和段限长加载到tr寄存器
+	// 加载tss选择子到tr寄存器，然后cpu会找到GDT中的描述符，把基地址和段限长加载到tr寄存器
 	ltr(0);
 	// 加载第一个任务的ldt选择子到ldt寄存器，然后cpu会找到GDT中的描述符，把基地址和段限长加载到ldtr寄存器
 	lldt(0);
@@ -515,4 +542,6 @@ void sched_init(void)
 	outb(inb_p(0x21)&~0x01,0x21);
 	// 系统调用处理函数
 	set_system_gate(0x80,&system_call);
+	// cpu支持的话再设置sysenter的入口，见kernel/sysenter.c
+	sysenter_init();
 }
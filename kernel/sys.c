@@ -11,6 +11,7 @@
 #include <linux/kernel.h>
 #include <asm/segment.h>
 #include <sys/times.h>
+#include <sys/pstat.h>
 #include <sys/utsname.h>
 
 int sys_ftime()
@@ -165,6 +166,48 @@ int sys_times(struct tms * tbuf)
 	return jiffies;
 }
 
+/*
+ * sys_pstat() fills in the statistics of up to 'count' tasks, and
+ * returns how many it filled in.
+ */
+int sys_pstat(struct pstat * buf, int count)
+{
+	struct task_struct ** p;
+	struct pstat ps;
+	int i, n = 0;
+
+	if (count <= 0)
+		return -EINVAL;
+	// 进程不会比nr_tasks多，大的count还会让下面的长度溢出
+	if (count > nr_tasks)
+		count = nr_tasks;
+	verify_area(buf,count * sizeof *buf);
+	for (p = &FIRST_TASK ; p <= &LAST_TASK && n < count ; p++) {
+		if (!*p)
+			continue;
+		ps.ps_pid = (*p)->pid;
+		ps.ps_ppid = (*p)->father;
+		ps.ps_pgrp = (*p)->pgrp;
+		ps.ps_state = (*p)->state;
+		ps.ps_utime = (*p)->utime;
+		ps.ps_stime = (*p)->stime;
+		ps.ps_wtime = (*p)->wtime;
+		ps.ps_start_time = (*p)->start_time;
+		ps.ps_nvcsw = (*p)->nvcsw;
+		ps.ps_nivcsw = (*p)->nivcsw;
+		ps.ps_minflt = (*p)->min_flt;
+		ps.ps_majflt = (*p)->maj_flt;
+		ps.ps_inblock = (*p)->inblock;
+		ps.ps_oublock = (*p)->oublock;
+		// 结构体的成员都是4个字节，逐个复制到用户空间
+		for (i=0 ; i<sizeof ps/sizeof(long) ; i++)
+			put_fs_long(((unsigned long *) &ps)[i],i+(unsigned long *) buf);
+		buf++;
+		n++;
+	}
+	return n;
+}
+
 int sys_brk(unsigned long end_data_seg)
 {
 	if (end_data_seg >= current->end_code &&
@@ -181,30 +224,31 @@ int sys_brk(unsigned long end_data_seg)
 // 设置进程的组id，只能修改同一会话的非首进程的组id
 int sys_setpgid(int pid, int pgid)
 {
-	int i;
+	struct task_struct * p;
 	// 默认设置当前进程的为当前进程的组id，可以是设置当前进程的pgid，或者设置某个进程的组id为当前进程的组id等
 	if (!pid)
 		pid = current->pid;
 	if (!pgid)
 		pgid = current->pid;
-	for (i=0 ; i<NR_TASKS ; i++)
-		// 找到当前进程
-		if (task[i] && task[i]->pid==pid) {
-			/*
-				不能设置会话首进程的组id，因为首进程的进程id，组id，会话id是一致的，
-				修改了组id，则意味着要修改会话id
-			*/
-			if (task[i]->leader)
-				return -EPERM;
-			/*
-				会话是进程组的集合，不能修改其他会话的进程组id，因为可能会导致会话id变化
-			*/
-			if (task[i]->session != current->session)
-				return -EPERM;
-			task[i]->pgrp = pgid;
-			return 0;
-		}
-	return -ESRCH;
+	// 通过pid哈希找到进程
+	if (!(p = find_task_by_pid(pid)))
+		return -ESRCH;
+	/*
+		不能设置会话首进程的组id，因为首进程的进程id，组id，会话id是一致的，
+		修改了组id，则意味着要修改会话id
+	*/
+	if (p->leader)
+		return -EPERM;
+	/*
+		会话是进程组的集合，不能修改其他会话的进程组id，因为可能会导致会话id变化
+	*/
+	if (p->session != current->session)
+		return -EPERM;
+	// 从旧的进程组哈希链移到新的
+	detach_pgrp(p);
+	p->pgrp = pgid;
+	attach_pgrp(p);
+	return 0;
 }
 
 int sys_getpgrp(void)
@@ -223,7 +267,11 @@ int sys_setsid(void)
 		sessionid是进程的id，因为会话是进程组的集合，
 		所以当前进程的组id也需要更新，否则进程在其他组，但是其他组又不属于当前的会话，矛盾
 	*/
+	detach_session(current);
+	detach_pgrp(current);
 	current->session = current->pgrp = current->pid;
+	attach_session(current);
+	attach_pgrp(current);
 	// 重置终端,会话领头进程第一个打开终端的时候赋值，一个会话对应一个终端
 	current->tty = -1;
 	return current->pgrp;
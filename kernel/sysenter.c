@@ -0,0 +1,84 @@
+/*
+ *  linux/kernel/sysenter.c
+ */
+
+/*
+ * 'sysenter.c' sets up the SYSENTER entry into the kernel, which is a lot
+ * cheaper than going through the interrupt gate of 'int $0x80'. The user
+ * side is in lib/syscall.c, and asks sys_sysenter() whether it may use it.
+ *
+ * Only the entry is fast. SYSEXIT returns to a flat 4Gb code segment with
+ * base 0, but the user segments in the ldt have base USER_BASE (every task
+ * has its own page directory, and they all use the same base), so the
+ * return still goes through ret_from_sys_call and 'iret'. The entry
+ * code in system_call.s builds the same stack frame as 'int $0x80' does,
+ * so nothing else (fork, signals) has to know about it.
+ */
+#include <linux/sched.h>
+#include <linux/kernel.h>
+
+#define MSR_SYSENTER_CS		0x174
+#define MSR_SYSENTER_ESP	0x175
+#define MSR_SYSENTER_EIP	0x176
+
+#define X86_FEATURE_SEP		(1<<11)
+
+extern void sysenter_entry(void);
+
+int sysenter_ok = 0;
+
+/*
+ * SYSENTER loads esp from the msr, and the first instruction of the entry
+ * code switches to the kernel stack of the current task. This stack is
+ * only for what hits before that: an nmi, or the single-step trap that
+ * SYSENTER takes when the user has TF set, which ends up in do_int3()
+ * and printk(), so it can't be tiny.
+ */
+static long sysenter_stack[256];
+
+#define wrmsr(msr,low,high) \
+__asm__ volatile (".byte 0x0f,0x30"::"c" (msr),"a" (low),"d" (high))
+
+// 能修改eflags的ID位（21位）说明支持cpuid指令
+static int have_cpuid(void)
+{
+	unsigned long f1, f2;
+
+	__asm__("pushfl\n\t"
+		"pushfl\n\t"
+		"popl %0\n\t"
+		"movl %0,%1\n\t"
+		"xorl $0x200000,%0\n\t"
+		"pushl %0\n\t"
+		"popfl\n\t"
+		"pushfl\n\t"
+		"popl %0\n\t"
+		"popfl"
+		:"=&r" (f1),"=&r" (f2));
+	return ((f1 ^ f2) & 0x200000) != 0;
+}
+
+void sysenter_init(void)
+{
+	unsigned long eax, ebx, ecx, edx;
+
+	if (!have_cpuid())
+		return;
+	__asm__(".byte 0x0f,0xa2"
+		:"=a" (eax),"=b" (ebx),"=c" (ecx),"=d" (edx)
+		:"0" (1));
+	if (!(edx & X86_FEATURE_SEP))
+		return;
+	// Pentium Pro报告了SEP，但并不支持这两条指令
+	if (((eax >> 8) & 0xf) == 6 && ((eax >> 4) & 0xf) < 3 && (eax & 0xf) < 3)
+		return;
+	wrmsr(MSR_SYSENTER_CS,0x08,0);
+	wrmsr(MSR_SYSENTER_ESP,(long) (sysenter_stack+256),0);
+	wrmsr(MSR_SYSENTER_EIP,(long) sysenter_entry,0);
+	sysenter_ok = 1;
+}
+
+int sys_sysenter(void)
+{
+	return sysenter_ok;
+}
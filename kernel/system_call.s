@@ -58,15 +58,17 @@ sa_mask = 4
 sa_flags = 8
 sa_restorer = 12
 
-nr_system_calls = 72
+nr_system_calls = 91
 
 /*
  * Ok, I get parallel printer interrupts while using the floppy for some
  * strange reason. Urgel. Now I just ignore them.
  */
-.globl _system_call,_sys_fork,_timer_interrupt,_sys_execve
+.globl _system_call,_sys_fork,_timer_interrupt,_sys_execve,_ret_from_fork
 .globl _hd_interrupt,_floppy_interrupt,_parallel_interrupt
 .globl _device_not_available, _coprocessor_error
+.globl _sysenter_entry,_sys_pread,_sys_pwrite,_sys_sendfile
+.globl _sys_epoll_ctl,_sys_epoll_wait,_sys_io_getevents
 
 .align 2
 bad_sys_call:
@@ -77,6 +79,31 @@ reschedule:
 	pushl $ret_from_sys_call
 	// 执行schedule
 	jmp _schedule
+/*
+ * sysenter_entry is where SYSENTER (see kernel/sysenter.c) lands us, with
+ * cs=0x08, ss=0x10, interrupts off and esp pointing to a dummy stack. The
+ * user stub in lib/syscall.c has left its esp in %ebp and the address to
+ * return to on top of its stack. We build the same frame 'int $0x80'
+ * would have, and go on as a normal system call, returning with 'iret'.
+ */
+.align 2
+_sysenter_entry:
+	// ds还是用户的，所以用ss访问内核数据。esp0（init_tss+4）是当前进程的内核栈顶，
+	// 一条指令换过去，之后来的debug和nmi用的都是内核栈
+	movl %ss:_init_tss+4,%esp
+	pushl $0x17		# user ss
+	pushl %ebp		# user esp
+	pushfl
+	// sysenter清了IF，返回用户态时要打开
+	orl $0x200,(%esp)
+	// sysenter不清TF，用户的TF已经存在上面了，内核里不单步
+	pushl $2
+	popfl
+	pushl $0x0f		# user cs
+	pushl %fs:-4(%ebp)	# user eip, pushed by the stub
+	sti
+	jmp _system_call
+
 .align 2
 _system_call:
 	// 比较参数，不合法的参数直接返回中断，错误码是-1
@@ -119,6 +146,12 @@ ret_from_sys_call:
 	jne 3f
 	cmpw $0x17,OLDSS(%esp)		# was stack segment = 0x17 ?
 	jne 3f
+	// 日志的定时器到期了，在这里提交，因为提交会睡眠，见fs/journal.c
+	cmpl $0,_journal_due
+	je 1f
+	call _journal_run
+	movl _current,%eax
+1:
 	// 把这两个字段赋值给寄存器
 	movl signal(%eax),%ebx
 	movl blocked(%eax),%ecx
@@ -230,6 +263,53 @@ _sys_execve:
 	addl $4,%esp
 	ret
 
+/*
+ * pread, pwrite, sendfile, epoll_ctl, epoll_wait and io_getevents take
+ * a fourth argument in %esi. It is still in the register here, as
+ * system_call doesn't touch it. The stubs put the function to call in %eax (the
+ * syscall number isn't needed any more) and share four_args.
+ */
+.align 2
+four_args:
+	pushl %esi
+	// 依次把edx,ecx,ebx再压一次，这样esi是第四个参数
+	pushl 16(%esp)
+	pushl 16(%esp)
+	pushl 16(%esp)
+	call *%eax
+	addl $16,%esp
+	ret
+
+.align 2
+_sys_pread:
+	movl $_do_pread,%eax
+	jmp four_args
+
+.align 2
+_sys_pwrite:
+	movl $_do_pwrite,%eax
+	jmp four_args
+
+.align 2
+_sys_sendfile:
+	movl $_do_sendfile,%eax
+	jmp four_args
+
+.align 2
+_sys_epoll_ctl:
+	movl $_do_epoll_ctl,%eax
+	jmp four_args
+
+.align 2
+_sys_epoll_wait:
+	movl $_do_epoll_wait,%eax
+	jmp four_args
+
+.align 2
+_sys_io_getevents:
+	movl $_do_io_getevents,%eax
+	jmp four_args
+
 .align 2
 _sys_fork:
 	// 执行find_empty_process函数，返回一个进程id在eax里
@@ -251,6 +331,18 @@ _sys_fork:
 	addl $20,%esp
 1:	ret
 
+/*
+ * A new task starts here the first time switch_to() jumps to it. Its
+ * kernel stack was set up by copy_process() to look like the return
+ * from the fork system call, with eax=0.
+ */
+.align 2
+_ret_from_fork:
+	popl %ebp
+	popl %edi
+	popl %esi
+	jmp ret_from_sys_call
+
 _hd_interrupt:
 	pushl %eax
 	pushl %ecx
@@ -0,0 +1,51 @@
+/*
+ *  linux/lib/syscall.c
+ */
+
+/*
+ * The _syscallN macros in <unistd.h> don't do 'int $0x80' themselves,
+ * they call through __syscall, with the arguments in the usual registers.
+ * The first call ends up in __syscall_probe, which asks the kernel if the
+ * cpu can do SYSENTER (see kernel/sysenter.c), and points __syscall at
+ * the right stub for all the calls after it.
+ *
+ * The sysenter stub leaves its esp in %ebp and the return address on
+ * top of its stack, which is all the kernel needs to build the frame that
+ * 'iret' returns with. %ebp is restored on the way back.
+ */
+#define __LIBRARY__
+#include <unistd.h>
+
+#define __str(x) #x
+#define str(x) __str(x)
+
+extern void __syscall_probe(void);
+
+long __syscall = (long) __syscall_probe;
+
+__asm__(".text\n"
+	".align 2\n"
+	"___syscall_int:\n\t"
+	"int $0x80\n\t"
+	"ret\n"
+	".align 2\n"
+	"___syscall_sysenter:\n\t"
+	"pushl %ebp\n\t"
+	"movl %esp,%ebp\n\t"
+	"pushl $1f\n\t"
+	".byte 0x0f,0x34\n"		/* sysenter */
+	"1:\tpopl %ebp\n\t"
+	"ret\n"
+	".align 2\n"
+	".globl ___syscall_probe\n"
+	"___syscall_probe:\n\t"
+	"pushl %eax\n\t"
+	"movl $" str(__NR_sysenter) ",%eax\n\t"
+	"int $0x80\n\t"
+	"testl %eax,%eax\n\t"
+	"movl $___syscall_int,%eax\n\t"
+	"jle 1f\n\t"
+	"movl $___syscall_sysenter,%eax\n"
+	"1:\tmovl %eax,___syscall\n\t"
+	"popl %eax\n\t"
+	"jmp *___syscall");
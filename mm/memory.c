@@ -35,9 +35,20 @@ static inline volatile void oom(void)
 	printk("out of memory\n\r");
 	do_exit(SIGSEGV);
 }
-// 置cr3为0，把0赋给eax，eax赋给cr3，cr3是保存页目录基地址的
+// 重新加载当前进程页目录的地址到cr3，cr3是保存页目录基地址的，这样会刷新tlb
 #define invalidate() \
-__asm__("movl %%eax,%%cr3"::"a" (0))
+__asm__("movl %%eax,%%cr3"::"a" (current->tss.cr3))
+
+/*
+ * Every task has a page-directory of its own. The entries below
+ * USER_BASE map the kernel and are the same in all of them: they are
+ * copied from pg_dir (task 0's directory) and point to the page tables
+ * set up in head.s, so they are never freed.
+ */
+#define KERNEL_PGD_ENTRIES (USER_BASE>>22)
+// 线性地址address在进程p的页目录中对应的页目录项地址
+#define pg_dir_entry(p,address) \
+((unsigned long *) ((p)->tss.cr3 + (((address)>>20) & 0xffc)))
 
 /* these are not to be changed without changing head.s etc */
 #define LOW_MEM 0x100000
@@ -56,13 +67,17 @@ static long HIGH_MEMORY = 0;
 #define copy_page(from,to) \
 __asm__("cld ; rep ; movsl"::"S" (from),"D" (to),"c" (1024):"cx","di","si")
 
-static unsigned char mem_map [ PAGING_PAGES ] = {0,};
+/*
+ * mem_map is a short array: with thousands of tasks a page that is
+ * shared by all of them (the text of init, say) would overflow a char.
+ */
+static unsigned short mem_map [ PAGING_PAGES ] = {0,};
 
 /*
  * Get physical address of first (actually last :-) free page, and mark it
  * used. If no free pages left, return 0.
  */
-unsigned long get_free_page(void)
+static inline unsigned long __get_free_page(void)
 {
 register unsigned long __res asm("ax");
 /*
@@ -71,9 +86,9 @@ register unsigned long __res asm("ax");
 	找到的话CF等于1。jne 1f说明cf等于0的时候跳到标签1处，即找不到，
 	找到后对一页的内容清0
 */
-__asm__("std ; repne ; scasb\n\t"
+__asm__("std ; repne ; scasw\n\t"
 	"jne 1f\n\t"
-	"movb $1,1(%%edi)\n\t"
+	"movw $1,2(%%edi)\n\t"
 	"sall $12,%%ecx\n\t"
 	"addl %2,%%ecx\n\t"
 	"movl %%ecx,%%edx\n\t"
@@ -91,6 +106,18 @@ __asm__("std ; repne ; scasb\n\t"
 return __res;
 }
 
+unsigned long get_free_page(void)
+{
+	unsigned long page;
+
+repeat:
+	page = __get_free_page();
+	// 没有空闲页了，先扔掉没人用的目录索引再试
+	if (!page && dindex_shrink())
+		goto repeat;
+	return page;
+}
+
 /*
  * Free a page of memory at physical address 'addr'. Used by
  * 'free_page_tables()'
@@ -133,9 +160,9 @@ int free_page_tables(unsigned long from,unsigned long size)
 		其中高20位是页表地址，低12位是标记位，，所以要乘以4得到
 		from对应的页目录项的地址。即dir = from >> 22 << 2 = from >> 20,
 		但是代码里是直接右移20位，所以需要和0xffc与，把低两位置0，最后得到from
-		对应的页目录项的地址
+		对应的页目录项在页目录中的偏移，再加上当前进程页目录的地址
 	*/
-	dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
+	dir = pg_dir_entry(current,from);
 	for ( ; size-->0 ; dir++) {
 		// 低位是1说明该页目录项有效
 		if (!(1 & *dir))
@@ -162,6 +189,45 @@ int free_page_tables(unsigned long from,unsigned long size)
 	return 0;
 }
 
+// 分配一个新的页目录，复制内核部分的页目录项，返回它的物理地址，没有内存则返回0
+unsigned long new_page_dir(void)
+{
+	unsigned long * dir;
+	int i;
+
+	if (!(dir = (unsigned long *) get_free_page()))
+		return 0;
+	for (i=0 ; i<KERNEL_PGD_ENTRIES ; i++)
+		dir[i] = pg_dir[i];
+	return (unsigned long) dir;
+}
+
+/*
+ * free_page_dir() gets rid of the page-directory of a task that will
+ * never run again, together with whatever user page tables are still
+ * hanging off it (exit() has normally freed them already).
+ */
+void free_page_dir(struct task_struct * p)
+{
+	unsigned long * dir, * pg_table;
+	int i, nr;
+
+	dir = (unsigned long *) p->tss.cr3;
+	if (!dir || dir == pg_dir)
+		return;
+	for (i=KERNEL_PGD_ENTRIES ; i<1024 ; i++) {
+		if (!(1 & dir[i]))
+			continue;
+		pg_table = (unsigned long *) (0xfffff000 & dir[i]);
+		for (nr=0 ; nr<1024 ; nr++)
+			if (1 & pg_table[nr])
+				free_page(0xfffff000 & pg_table[nr]);
+		free_page(0xfffff000 & dir[i]);
+	}
+	free_page((unsigned long) dir);
+	p->tss.cr3 = 0;
+}
+
 /*
  *  Well, here is one of the most complicated functions in mm. It
  * copies a range of linerar addresses by copying only the pages.
@@ -179,8 +245,9 @@ int free_page_tables(unsigned long from,unsigned long size)
  * 1 Mb-range, so the pages can be shared with the kernel. Thus the
  * special case for nr=xxxx.
  */
-// 在fork的时候调用，复制父进程页表。把线性地址from开始的n个MB地址对应的页表和页目录项的内容复制给to对应的页表和页目录项
-int copy_page_tables(unsigned long from,unsigned long to,long size)
+// 在fork的时候调用，复制父进程页表。把当前进程线性地址from开始的n个MB地址对应的页表和页目录项的内容复制给进程p中to对应的页表和页目录项
+int copy_page_tables(unsigned long from,unsigned long to,long size,
+	struct task_struct * p)
 {
 	unsigned long * from_page_table;
 	unsigned long * to_page_table;
@@ -190,10 +257,10 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 	// 4MB对齐
 	if ((from&0x3fffff) || (to&0x3fffff))
 		panic("copy_page_tables called with wrong alignment");
-	// 源页目录项物理地址
-	from_dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
-	// 目的目录项物理地址
-	to_dir = (unsigned long *) ((to>>20) & 0xffc);
+	// 源页目录项物理地址，在当前进程的页目录中
+	from_dir = pg_dir_entry(current,from);
+	// 目的目录项物理地址，在子进程的页目录中
+	to_dir = pg_dir_entry(p,to);
 	// 多少个MB
 	size = ((unsigned) (size+0x3fffff)) >> 22;
 	for( ; size-->0 ; from_dir++,to_dir++) {
@@ -256,15 +323,15 @@ unsigned long put_page(unsigned long page,unsigned long address)
 {
 	unsigned long tmp, *page_table;
 
-/* NOTE !!! This uses the fact that _pg_dir=0 */
+/* NOTE !!! This always works on the current page-directory */
 
 	if (page < LOW_MEM || page >= HIGH_MEMORY)
 		printk("Trying to put page %p at %p\n",page,address);
 	// page对应的物理页面没有被分配则说明有问题
 	if (mem_map[(page-LOW_MEM)>>12] != 1)
 		printk("mem_map disagrees with %p at %p\n",page,address);
-	// 计算页目录项的偏移地址，页目录首地址再物理地址0处。这里算出偏移地址后，就是绝对地址，与0xffc即四字节对齐
-	page_table = (unsigned long *) ((address>>20) & 0xffc);
+	// 计算页目录项的地址，当前进程页目录的首地址加上页目录项的偏移，与0xffc即四字节对齐
+	page_table = pg_dir_entry(current,address);
 	// 页目录项已经指向了一个有效的页表
 	if ((*page_table)&1)
 		// 算出页表首地址，*page_table的高20位是有效地址
@@ -337,7 +404,8 @@ void do_wp_page(unsigned long error_code,unsigned long address)
 	*/
 	un_wp_page((unsigned long *)
 		(((address>>10) & 0xffc) + (0xfffff000 &
-		*((unsigned long *) ((address>>20) &0xffc)))));
+		*pg_dir_entry(current,address))));
+	current->min_flt++;
 
 }
 // address是线性地址,判断页面是否可写，不可写则新申请页面，解除共享状态
@@ -345,7 +413,7 @@ void write_verify(unsigned long address)
 {
 	unsigned long page;
 	// address>>20 = address>>22<<2,page指向目录项内容，if判断页目录项是否指向了有效的页表项
-	if (!( (page = *((unsigned long *) ((address>>20) & 0xffc)) )&1))
+	if (!( (page = *pg_dir_entry(current,address)) &1))
 		return;
 	page &= 0xfffff000;// 取页目录项内容的高二十位，即页表的物理首地址
 	page += ((address>>10) & 0xffc); // 页表首地址+页表项偏移，算出页表项的地址
@@ -387,9 +455,9 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 	*/
 	from_page = to_page = ((address>>20) & 0xffc);
 	// p进程的代码开始地址（线性地址），取得p进程的页目录项地址，再加上address算出的偏移
-	from_page += ((p->start_code>>20) & 0xffc);
-	// 取得当前进程的页目录项地址，页目录物理地址是0，所以这里就是该地址对应的页目录项的物理地址
-	to_page += ((current->start_code>>20) & 0xffc);
+	from_page += (unsigned long) pg_dir_entry(p,p->start_code);
+	// 取得当前进程的页目录项地址，两个进程的页目录不同
+	to_page += (unsigned long) pg_dir_entry(current,current->start_code);
 /* is there a page-directory at from? */
 	// from是页表的物理地址和标记位
 	from = *(unsigned long *) from_page;
@@ -484,12 +552,17 @@ void do_no_page(unsigned long error_code,unsigned long address)
 	tmp = address - current->start_code;
 	// tmp大于等于end_data说明是访问堆或者栈的空间时发生的缺页,直接申请一页
 	if (!current->executable || tmp >= current->end_data) {
+		current->min_flt++;
 		get_empty_page(address);
 		return;
 	}
 	// 是否有进程已经使用了
-	if (share_page(tmp))
+	if (share_page(tmp)) {
+		current->min_flt++;
 		return;
+	}
+	// 要从硬盘读可执行文件的内容
+	current->maj_flt++;
 	// 获取一页，4kb
 	if (!(page = get_free_page()))
 		oom();
@@ -551,12 +624,13 @@ void calc_mem(void)
 {
 	int i,j,k,free=0;
 	long * pg_tbl;
+	long * dir = (long *) current->tss.cr3;
 	for(i=0 ; i<PAGING_PAGES ; i++)
 		if (!mem_map[i]) free++;
 	printk("%d pages free (of %d)\n\r",free,PAGING_PAGES);
 	for(i=2 ; i<1024 ; i++) {
-		if (1&pg_dir[i]) {
-			pg_tbl=(long *) (0xfffff000 & pg_dir[i]);
+		if (1&dir[i]) {
+			pg_tbl=(long *) (0xfffff000 & dir[i]);
 			for(j=k=0 ; j<1024 ; j++)
 				if (pg_tbl[j]&1)
 					k++;